@@ -27,9 +27,29 @@ Copyright (C) <2021>  <Ivor Spence>
 #include <time.h>
 #include <signal.h>
 #include <malloc.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <unistd.h>
+#include <errno.h>
+#include <limits.h>
 #include <sys/times.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_BZLIB
+#include <bzlib.h>
+#endif
 
 
 
@@ -44,6 +64,12 @@ Copyright (C) <2021>  <Ivor Spence>
 #define false 0
 #define true 1
 
+#define COMPRESSION_NONE 0
+#define COMPRESSION_GZIP 1
+#define COMPRESSION_XZ 2
+#define COMPRESSION_BZIP2 3
+#define COMPRESSION_COUNT 4
+
 #define uint64_t unsigned long long
 
 #pragma intrinsic (memset, memcpy, memcmp)
@@ -51,10 +77,13 @@ Copyright (C) <2021>  <Ivor Spence>
 //#define uint64_t __m128i
 
 uint64_t bytes=0;
-int megaBytes=0, gigaBytes=0;
+int megaBytes=0, gigaBytes=0, memoryLimitMegaBytes;
 
 FILE *inFile, *outFile;
 char *filename;
+int inputCompression = COMPRESSION_NONE, inputBinary = false;
+char *writeBinaryName, *writeDimacsName, *cacheDir;
+uint64_t inputHash;
 int *optimised;
 
 int traceLevel;
@@ -69,8 +98,9 @@ time_t startTime;
 int ch;
 int originalNumVars, originalNumClauses, numFirstVars;
 int numVars, numClauses, unusedVariables;
-int elapsedLimit, cpuLimit, turnsLimit, memoryLimit, noReduce;
+int elapsedLimit, cpuLimit, turnsLimit, memoryLimit, noReduce, numThreads, streamWindow, backboneTime, regionSweepClauses, orderPortfolio, portfolioTime, predictReport, predictSamples;
 char *memoryReason = "";
+char *unsatReason = "unit propagation";
 int bitSetCount = 0;
 uint64_t operations = 0;
 
@@ -157,6 +187,80 @@ void fprintProposition (FILE *f, int numVars, int numClauses, ClausePtr *clauses
 	}
 }
 
+/* The binary format holds the clauses exactly as read from DIMACS (after
+   tautologies and duplicate literals have been removed). After the header
+   comes a payload of payloadSize bytes in which each clause is its length
+   followed by its literals in litCompare order, coded as 2*var+(lit>0), the
+   first in full and the rest as differences from their predecessor. All
+   numbers in the payload are LEB128 varints, and the clauses are found by
+   reading them in order. */
+
+#define BINARY_MAGIC "SUMCBIN2"
+
+typedef struct BinaryHeaderStruct
+{
+	char magic[8];
+	unsigned int numVars, headerClauses, numClauses, reserved;
+	uint64_t payloadSize;
+} BinaryHeader;
+
+int varintSize (unsigned int value)
+{
+	int result = 1;
+	while (value >= 0x80)
+	{
+		value >>= 7;
+		result++;
+	}
+	return result;
+}
+
+void fputVarint (FILE *f, unsigned int value)
+{
+	while (value >= 0x80)
+	{
+		fputc ((value & 0x7F) | 0x80, f);
+		value >>= 7;
+	}
+	fputc (value, f);
+}
+
+#define LIT2CODE(l)	((l>0)?(2*(l)+1):(-2*(l)))
+#define CODE2LIT(c)	((c%2==1)?((int)((c)/2)):(-(int)((c)/2)))
+
+void fwriteBinaryProposition (FILE *f, int numVars, int headerClauses, int numClauses, ClausePtr *clauses)
+{
+	BinaryHeader header;
+	uint64_t offset;
+	int c,i;
+	ClausePtr clause;
+	
+	memset (&header, 0, sizeof(header));
+	memcpy (header.magic, BINARY_MAGIC, sizeof(header.magic));
+	header.numVars = numVars;
+	header.headerClauses = headerClauses;
+	header.numClauses = numClauses;
+	
+	offset = 0;
+	for (c=0; c<numClauses; c++)
+	{
+		clause = clauses[c];
+		offset += varintSize (clause->length);
+		for (i=0; i<clause->length; i++)
+			offset += varintSize (LIT2CODE(clause->lits[i]) - ((i == 0) ? 0 : LIT2CODE(clause->lits[i-1])));
+	}
+	header.payloadSize = offset;
+	fwrite (&header, sizeof(header), 1, f);
+	
+	for (c=0; c<numClauses; c++)
+	{
+		clause = clauses[c];
+		fputVarint (f, clause->length);
+		for (i=0; i<clause->length; i++)
+			fputVarint (f, LIT2CODE(clause->lits[i]) - ((i == 0) ? 0 : LIT2CODE(clause->lits[i-1])));
+	}
+}
+
 typedef struct TreeNodeStruct
 {
 	int lit, bitPos;
@@ -167,7 +271,10 @@ typedef struct TreeNodeStruct
 
 int *litsBuffer;
 ClausePtr *clauses;
-int *mapVariables,*unmapVariables;
+int *mapVariables,*unmapVariables,*variableMap;
+int *startvs,*finishvs,regionsCount;
+int *regionStartc, *regionFinishc;
+
 int **firstVars, **lastVars;
 BlockListPtr clauseSet, nextClauseSet;
 int pos=0;
@@ -186,7 +293,17 @@ typedef struct HashTableStruct
 void bitSetcheckFree (BitSetPtr bs);
 unsigned int bitSetHashCode (BitSetPtr bs);
 int clauseCompare (const void *c1, const void *c2);
+ClausePtr clauseAt (int c);
 void printBitSetTables();
+void findRegionClauses();
+uint64_t mixHash (uint64_t a, uint64_t b);
+
+/* Set in a child process counting one region, and the product of the
+   counts returned by the children. */
+FILE *regionResult;
+mpz_t regionsProduct;
+void reportRegionResult (int status);
+void stopRegionWorkers();
 
 
 int strEqual (char *s1, char *s2)
@@ -212,11 +329,19 @@ void printFinal(int status)
 	time (&endTime);
 	mpz_t finalCount;
 	
+	if (regionResult != NULL)
+		reportRegionResult (status);
+	stopRegionWorkers();
+	
 	switch (status)
 	{
 		case STATUS_SUCCESSFUL:
 			mpz_init (finalCount);
-			mpz_mul_2exp (finalCount, ((BitSetPtr)clauseSet->first->items[0])->contribution, unusedVariables);
+			if (clauseSet != NULL)
+				mpz_mul (finalCount, ((BitSetPtr)clauseSet->first->items[0])->contribution, regionsProduct);
+			else
+				mpz_set (finalCount, regionsProduct);
+			mpz_mul_2exp (finalCount, finalCount, unusedVariables);
 			if (mpz_sgn(finalCount) == 0)
 				fprintf (outFile, "s UNSATISFIABLE\n");
 			else
@@ -237,9 +362,9 @@ void printFinal(int status)
 		case STATUS_UNSAT_FOUND:
 			fprintf (outFile, "s UNSATISFIABLE\n");
 			fprintf (outFile, "c s mc\n");
-			fprintf (outFile, "c o UNSAT found by unit propagation\n");
-			fprintf (outFile, "c s log10-estimate -inf");
-			fprintf (outFile, "c s exact arb int 0");
+			fprintf (outFile, "c o UNSAT found by %s\n", unsatReason);
+			fprintf (outFile, "c s log10-estimate -inf\n");
+			fprintf (outFile, "c s exact arb int 0\n");
 			fprintf (outFile, "c o CPU-TIME-SECONDS=%.1f\n", getCPUTimeSinceStart());
 			fprintf (outFile, "c o ELAPSED-TIME-SECONDS=%.1f\n", difftime (endTime, startTime));
 			fprintf (outFile, "c o STATUS=SUCCESS\n");
@@ -327,10 +452,9 @@ void * checkMalloc (size_t size, char *reason)
 	
 	if (memoryLimit > 0)
 	{
-		bytes += malloc_usable_size (result);
-		megaBytes = bytes/(1024*1024);
+		megaBytes = __sync_add_and_fetch (&bytes, malloc_usable_size (result))/(1024*1024);
 		gigaBytes = megaBytes/1024;
-		if (gigaBytes > memoryLimit)
+		if (megaBytes > memoryLimitMegaBytes)
 		{
 			memoryReason = reason;
 			printFinal (STATUS_OUT_OF_MEMORY);
@@ -357,10 +481,9 @@ void * checkRealloc (void *p, size_t size, char *reason)
 	if (memoryLimit > 0)
 	{
 		newSize = malloc_usable_size (result);
-		bytes += newSize-oldSize;
-		megaBytes = bytes/(1024*1024);
+		megaBytes = __sync_add_and_fetch (&bytes, newSize-oldSize)/(1024*1024);
 		gigaBytes = megaBytes/1024;
-		if (gigaBytes > memoryLimit)
+		if (megaBytes > memoryLimitMegaBytes)
 		{
 			memoryReason = reason;
 			printFinal (STATUS_OUT_OF_MEMORY);
@@ -375,7 +498,7 @@ void checkFree (void *p)
 {
 	if (memoryLimit > 0)
 	{
-		bytes -= malloc_usable_size (p);
+		__sync_sub_and_fetch (&bytes, malloc_usable_size (p));
 	}
 	
 	free(p);
@@ -804,6 +927,66 @@ int getIntOption (int argc, char *argv[], char *tag, int defaultValue)
 	return result;
 }
 
+char *compressionNames[COMPRESSION_COUNT] = {"none", "gzip", "xz", "bzip2"};
+
+char *compressionName (int compression)
+{
+	return (compression >= 0 && compression < COMPRESSION_COUNT) ? compressionNames[compression] : "unknown";
+}
+
+int compressionOf (int fd)
+{
+	unsigned char magic[6];
+	ssize_t count;
+	
+	count = pread (fd, magic, sizeof(magic), 0);
+	if (count >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+		return COMPRESSION_GZIP;
+	if (count >= 6 && memcmp (magic, "\xFD" "7zXZ\0", 6) == 0)
+		return COMPRESSION_XZ;
+	if (count >= 3 && memcmp (magic, "BZh", 3) == 0)
+		return COMPRESSION_BZIP2;
+	return COMPRESSION_NONE;
+}
+
+int compressionSupported (int compression)
+{
+	switch (compression)
+	{
+#ifdef HAVE_ZLIB
+		case COMPRESSION_GZIP:
+#endif
+#ifdef HAVE_LZMA
+		case COMPRESSION_XZ:
+#endif
+#ifdef HAVE_BZLIB
+		case COMPRESSION_BZIP2:
+#endif
+		case COMPRESSION_NONE:
+			return true;
+		default:
+			return false;
+	}
+}
+
+char *getStringOption (int argc, char *argv[], char *tag, char *defaultValue)
+{
+	int p;
+	
+	for (p=0; p<argc; p++)
+		if (strPrefix (tag,argv[p]))
+			return argv[p] + strlen(tag);
+	
+	return defaultValue;
+}
+
+int isBinaryProposition (int fd)
+{
+	char magic[8];
+	
+	return pread (fd, magic, sizeof(magic), 0) == sizeof(magic) && memcmp (magic, BINARY_MAGIC, sizeof(magic)) == 0;
+}
+
 void processArgs (int argc, char *argv[])
 {
 	int i;
@@ -828,6 +1011,21 @@ void processArgs (int argc, char *argv[])
 		else
 		{
 			fprintf (outFile, "c o FILENAME=<%s>\n", filename); fflush(stdout);
+			inputBinary = isBinaryProposition (fileno(inFile));
+			if (inputBinary)
+			{
+				fprintf (outFile, "c o FORMAT=binary\n"); fflush(stdout);
+			}
+			inputCompression = compressionOf (fileno(inFile));
+			if (inputCompression != COMPRESSION_NONE)
+			{
+				fprintf (outFile, "c o COMPRESSION=%s\n", compressionName (inputCompression)); fflush(stdout);
+				if (!compressionSupported (inputCompression))
+				{
+					fprintf (outFile, "c Error - no %s support compiled in\n", compressionName (inputCompression));
+					printFinal (STATUS_SYNTAX_ERROR);
+				}
+			}
 		}
 	}
 	
@@ -836,23 +1034,409 @@ void processArgs (int argc, char *argv[])
 	elapsedLimit = getIntOption (argc, argv, "--timeout=", -1);
 	cpuLimit = getIntOption (argc, argv, "--cpu-timeout=", -1);
 	memoryLimit = getIntOption (argc, argv, "--maxrss=", -1);
+	memoryLimitMegaBytes = 1024*memoryLimit;
 	if (memoryLimit > 0)
 		mp_set_memory_functions (gmpMalloc, gmpRealloc, gmpFree);
 	noReduce = getIntOption (argc, argv, "--noreduce=", 0);
+	writeBinaryName = getStringOption (argc, argv, "--write-binary=", NULL);
+	writeDimacsName = getStringOption (argc, argv, "--write-dimacs=", NULL);
+	cacheDir = getStringOption (argc, argv, "--cache=", NULL);
+	numThreads = getIntOption (argc, argv, "--threads=", 1);
+	streamWindow = getIntOption (argc, argv, "--stream-window=", 0);
+	backboneTime = getIntOption (argc, argv, "--backbone-time=", 0);
+	regionSweepClauses = getIntOption (argc, argv, "--region-sweep-clauses=", 1000);
+	orderPortfolio = getIntOption (argc, argv, "--order-portfolio=", 0);
+	portfolioTime = getIntOption (argc, argv, "--portfolio-time=", 30);
+	predictReport = getIntOption (argc, argv, "--predict=", 0);
+	predictSamples = getIntOption (argc, argv, "--predict-samples=", 64);
 	if (elapsedLimit > 0)
 		fprintf (outFile, "c o TIMEOUT-SECONDS=%d\n", elapsedLimit);
 	if (cpuLimit > 0)
 		fprintf (outFile, "c o CPU-TIMEOUT-SECONDS=%d\n", cpuLimit);
 	if (memoryLimit > 0)
 		fprintf (outFile, "c o MAX-MEMORY=%dGB\n", memoryLimit);
+	if (numThreads > 1)
+		fprintf (outFile, "c o THREADS=%d\n", numThreads);
 	fflush(stdout);
 }
 
 
 
+/* The input is read either from a memory mapping of the whole file or, when
+   that is not possible, by a separate thread into a ring of large blocks
+   which the lexer consumes in turn. Standard input and pipes are read with
+   read(2) into two blocks, so that reading overlaps with parsing; compressed
+   files are decoded into the ring in the same way. The lexer only sees the
+   current block [inputNext,inputLimit). */
+
+#define INPUT_BLOCK_SIZE (1<<22)
+#define INPUT_RING_BLOCKS 4
+#define INPUT_PIPE_BLOCKS 2
+
+char *inputData, *inputNext, *inputLimit;
+size_t inputSize;
+int inputMapped;
+
+typedef struct InputRingStruct
+{
+	char *blocks[INPUT_RING_BLOCKS];
+	size_t counts[INPUT_RING_BLOCKS];
+	int numBlocks, readBlock, writeBlock, filled, holding, finished, failed, abandoned;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	pthread_t thread;
+} InputRing, *InputRingPtr;
+
+InputRingPtr inputRing = NULL;
+
+/* Called by the producer: waits for a free block and returns it, or NULL if
+   the lexer needs no more input. */
+char *ringBlockToFill()
+{
+	char *result;
+	
+	pthread_mutex_lock (&inputRing->lock);
+	while (inputRing->filled == inputRing->numBlocks && !inputRing->abandoned)
+		pthread_cond_wait (&inputRing->changed, &inputRing->lock);
+	result = inputRing->abandoned ? NULL : inputRing->blocks[inputRing->writeBlock];
+	pthread_mutex_unlock (&inputRing->lock);
+	
+	return result;
+}
+
+/* Called by the producer when count bytes of the block from ringBlockToFill
+   are ready. */
+void ringBlockFilled (size_t count)
+{
+	if (count == 0)
+		return;
+	pthread_mutex_lock (&inputRing->lock);
+	inputRing->counts[inputRing->writeBlock] = count;
+	inputRing->writeBlock = (inputRing->writeBlock+1) % inputRing->numBlocks;
+	inputRing->filled++;
+	pthread_cond_broadcast (&inputRing->changed);
+	pthread_mutex_unlock (&inputRing->lock);
+}
+
+void ringFinished (int failed)
+{
+	pthread_mutex_lock (&inputRing->lock);
+	inputRing->finished = true;
+	inputRing->failed = failed;
+	pthread_cond_broadcast (&inputRing->changed);
+	pthread_mutex_unlock (&inputRing->lock);
+}
+
+/* Called by the lexer: releases the block it has finished with and waits for
+   the next one. Returns false at the end of the input. */
+int ringNextBlock()
+{
+	int result;
+	
+	pthread_mutex_lock (&inputRing->lock);
+	if (inputRing->holding)
+	{
+		inputRing->readBlock = (inputRing->readBlock+1) % inputRing->numBlocks;
+		inputRing->filled--;
+		inputRing->holding = false;
+		pthread_cond_broadcast (&inputRing->changed);
+	}
+	while (inputRing->filled == 0 && !inputRing->finished)
+		pthread_cond_wait (&inputRing->changed, &inputRing->lock);
+	result = inputRing->filled > 0;
+	if (result)
+	{
+		inputRing->holding = true;
+		inputNext = inputRing->blocks[inputRing->readBlock];
+		inputLimit = inputNext + inputRing->counts[inputRing->readBlock];
+	}
+	pthread_mutex_unlock (&inputRing->lock);
+	
+	if (!result && inputRing->failed)
+	{
+		fprintf (outFile, "c Error - could not read input\n");
+		printFinal (STATUS_SYNTAX_ERROR);
+	}
+	
+	return result;
+}
+
+void *pipeProducer (void *arg)
+{
+	char *block;
+	ssize_t count = 0;
+	size_t used;
+	
+	(void) arg;
+	do
+	{
+		block = ringBlockToFill();
+		if (block == NULL)
+			break;
+		used = 0;
+		count = 1;
+		while (used < INPUT_BLOCK_SIZE && (count > 0 || (count < 0 && errno == EINTR)))
+		{
+			count = read (fileno(inFile), block+used, INPUT_BLOCK_SIZE-used);
+			if (count > 0)
+				used += count;
+		}
+		ringBlockFilled (used);
+	} while (used == INPUT_BLOCK_SIZE);
+	ringFinished (count < 0);
+	return NULL;
+}
+
+#ifdef HAVE_ZLIB
+void *gzipProducer (void *arg)
+{
+	gzFile gz;
+	char *block;
+	int count;
+	
+	(void) arg;
+	gz = gzdopen (dup (fileno(inFile)), "rb");
+	if (gz == NULL)
+	{
+		ringFinished (true);
+		return NULL;
+	}
+	gzbuffer (gz, 1<<18);
+	count = 0;
+	do
+	{
+		block = ringBlockToFill();
+		if (block == NULL)
+			break;
+		count = gzread (gz, block, INPUT_BLOCK_SIZE);
+		if (count > 0)
+			ringBlockFilled (count);
+	} while (count > 0);
+	gzclose (gz);
+	ringFinished (count < 0);
+	return NULL;
+}
+#endif
+
+#ifdef HAVE_LZMA
+void *xzProducer (void *arg)
+{
+	lzma_stream stream = LZMA_STREAM_INIT;
+	lzma_action action = LZMA_RUN;
+	lzma_ret ret;
+	unsigned char *compressed;
+	ssize_t count;
+	
+	(void) arg;
+	if (lzma_stream_decoder (&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+	{
+		ringFinished (true);
+		return NULL;
+	}
+	compressed = checkMalloc (1<<18, "xzinput");
+	stream.next_out = (unsigned char *) ringBlockToFill();
+	stream.avail_out = INPUT_BLOCK_SIZE;
+	ret = (stream.next_out == NULL) ? LZMA_STREAM_END : LZMA_OK;
+	while (ret == LZMA_OK)
+	{
+		if (stream.avail_in == 0 && action == LZMA_RUN)
+		{
+			count = read (fileno(inFile), compressed, 1<<18);
+			if (count <= 0)
+				action = LZMA_FINISH;
+			stream.next_in = compressed;
+			stream.avail_in = (count > 0) ? count : 0;
+		}
+		ret = lzma_code (&stream, action);
+		if (stream.avail_out == 0 || ret != LZMA_OK)
+		{
+			ringBlockFilled (INPUT_BLOCK_SIZE - stream.avail_out);
+			if (ret == LZMA_OK)
+			{
+				stream.next_out = (unsigned char *) ringBlockToFill();
+				stream.avail_out = INPUT_BLOCK_SIZE;
+				if (stream.next_out == NULL)
+					break;
+			}
+		}
+	}
+	lzma_end (&stream);
+	checkFree (compressed);
+	ringFinished (ret != LZMA_STREAM_END);
+	return NULL;
+}
+#endif
+
+#ifdef HAVE_BZLIB
+void *bzip2Producer (void *arg)
+{
+	BZFILE *bz;
+	char *block, unused[BZ_MAX_UNUSED];
+	void *unusedPtr;
+	int error, count, numUnused, used;
+	
+	(void) arg;
+	numUnused = 0;
+	block = ringBlockToFill();
+	used = 0;
+	if (block == NULL)
+		error = BZ_SEQUENCE_ERROR;
+	else do
+	{
+		bz = BZ2_bzReadOpen (&error, inFile, 0, 0, unused, numUnused);
+		while (error == BZ_OK)
+		{
+			count = BZ2_bzRead (&error, bz, block+used, INPUT_BLOCK_SIZE-used);
+			if (error == BZ_OK || error == BZ_STREAM_END)
+			{
+				used += count;
+				if (used == INPUT_BLOCK_SIZE)
+				{
+					ringBlockFilled (used);
+					block = ringBlockToFill();
+					used = 0;
+					if (block == NULL)
+						error = BZ_SEQUENCE_ERROR;
+				}
+			}
+		}
+		if (error == BZ_STREAM_END)
+		{
+			/* a further stream may follow, as written by parallel compressors */
+			BZ2_bzReadGetUnused (&error, bz, &unusedPtr, &numUnused);
+			memcpy (unused, unusedPtr, numUnused);
+			BZ2_bzReadClose (&error, bz);
+			if (numUnused == 0)
+			{
+				count = fgetc (inFile);
+				if (count == EOF)
+					break;
+				ungetc (count, inFile);
+			}
+			error = BZ_OK;
+		}
+		else
+			BZ2_bzReadClose (&count, bz);
+	} while (error == BZ_OK);
+	if (block != NULL)
+		ringBlockFilled (used);
+	ringFinished (error != BZ_OK);
+	return NULL;
+}
+#endif
+
+void startInputRing (void *producer (void *), int numBlocks)
+{
+	int b;
+	
+	inputRing = checkMalloc (sizeof(InputRing), "inputring");
+	inputRing->numBlocks = numBlocks;
+	for (b=0; b<inputRing->numBlocks; b++)
+		inputRing->blocks[b] = checkMalloc (INPUT_BLOCK_SIZE, "inputblock");
+	inputRing->readBlock = 0;
+	inputRing->writeBlock = 0;
+	inputRing->filled = 0;
+	inputRing->holding = false;
+	inputRing->finished = false;
+	inputRing->failed = false;
+	inputRing->abandoned = false;
+	pthread_mutex_init (&inputRing->lock, NULL);
+	pthread_cond_init (&inputRing->changed, NULL);
+	if (pthread_create (&inputRing->thread, NULL, producer, NULL) != 0)
+	{
+		memoryReason = "input thread";
+		printFinal (STATUS_OUT_OF_MEMORY);
+	}
+	inputNext = NULL;
+	inputLimit = NULL;
+}
+
+void stopInputRing()
+{
+	int b;
+	
+	pthread_mutex_lock (&inputRing->lock);
+	inputRing->abandoned = true;
+	pthread_cond_broadcast (&inputRing->changed);
+	pthread_mutex_unlock (&inputRing->lock);
+	pthread_join (inputRing->thread, NULL);
+	
+	for (b=0; b<inputRing->numBlocks; b++)
+		checkFree (inputRing->blocks[b]);
+	pthread_mutex_destroy (&inputRing->lock);
+	pthread_cond_destroy (&inputRing->changed);
+	checkFree (inputRing);
+	inputRing = NULL;
+}
+
+void openInput()
+{
+	struct stat st;
+	
+	inputMapped = false;
+	switch (inputCompression)
+	{
+#ifdef HAVE_ZLIB
+		case COMPRESSION_GZIP:
+			startInputRing (gzipProducer, INPUT_RING_BLOCKS);
+			return;
+#endif
+#ifdef HAVE_LZMA
+		case COMPRESSION_XZ:
+			startInputRing (xzProducer, INPUT_RING_BLOCKS);
+			return;
+#endif
+#ifdef HAVE_BZLIB
+		case COMPRESSION_BZIP2:
+			startInputRing (bzip2Producer, INPUT_RING_BLOCKS);
+			return;
+#endif
+		default:
+			break;
+	}
+	
+	if (inFile != stdin && fstat (fileno(inFile), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		inputData = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(inFile), 0);
+		if (inputData != MAP_FAILED)
+		{
+			madvise (inputData, st.st_size, MADV_SEQUENTIAL);
+			inputMapped = true;
+			inputSize = st.st_size;
+			inputNext = inputData;
+			inputLimit = inputData + inputSize;
+			return;
+		}
+	}
+	
+	startInputRing (pipeProducer, INPUT_PIPE_BLOCKS);
+}
+
+int refillInput()
+{
+	if (inputMapped)
+		return false;
+	
+	return ringNextBlock();
+}
+
+void closeInput()
+{
+	if (inputRing != NULL)
+		stopInputRing();
+	else if (inputMapped)
+		munmap (inputData, inputSize);
+	inputData = NULL;
+	inputNext = NULL;
+	inputLimit = NULL;
+}
+
 void nextCh()
 {
-	ch = fgetc(inFile);
+	if (inputNext == inputLimit && !refillInput())
+		ch = EOF;
+	else
+		ch = (unsigned char) *inputNext++;
 }
 
 void accept (char *s)
@@ -888,42 +1472,145 @@ int isDigit (char c)
 	return '0' <= c && c <= '9';
 }
 
+/* Literals are converted eight bytes at a time: the bytes are tested for
+   being digits in parallel and the leading run of digits is combined into
+   its value with three multiplications. */
+
+uint64_t powersOf10[] = {1,10,100,1000,10000,100000,1000000,10000000,100000000};
+
+/* Returns the number (0 to 8) of leading decimal digits in the eight bytes at
+   p and sets *value to the number they represent. */
+int swarParseDigits (char *p, uint64_t *value)
+{
+	uint64_t word, nonDigits;
+	int length;
+	
+	memcpy (&word, p, sizeof(word));
+	word ^= 0x3030303030303030ULL;
+	nonDigits = ((word + 0x7676767676767676ULL) | word) & 0x8080808080808080ULL;
+	length = (nonDigits == 0) ? 8 : __builtin_ctzll(nonDigits)/8;
+	if (length == 0)
+	{
+		*value = 0;
+		return 0;
+	}
+	
+	word <<= 8*(8-length);
+	word = ((word & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+	word = ((word & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+	*value = ((word & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+	return length;
+}
+
+/* Converts the digits starting at p and returns the position after them. At
+   most a few digits beyond ten are consumed, so that the caller can detect
+   values too large for an int from *digits. */
+char *scanDigits (char *p, char *limit, long long *value, int *digits)
+{
+	uint64_t part;
+	int length;
+	
+	*value = 0;
+	*digits = 0;
+	while (limit-p >= 8 && *digits <= 10)
+	{
+		length = swarParseDigits (p, &part);
+		*value = *value*powersOf10[length] + part;
+		*digits += length;
+		p += length;
+		if (length < 8)
+			return p;
+	}
+	while (p < limit && isDigit(*p) && *digits <= 10)
+	{
+		*value = *value*10 + (*p++ - '0');
+		(*digits)++;
+	}
+	return p;
+}
+
+/* Skips blanks and line ends, sixteen bytes at a time where the buffer
+   allows, and sets *lineEnd if a line end was passed. */
+char *skipSeparators (char *p, char *limit, int *lineEnd)
+{
+#ifdef __SSE2__
+	__m128i block;
+	unsigned int separators, lineEnds;
+	int skip;
+	
+	while (limit-p >= 16)
+	{
+		block = _mm_loadu_si128 ((__m128i *) p);
+		lineEnds = _mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (block, _mm_set1_epi8('\n')),
+			_mm_cmpeq_epi8 (block, _mm_set1_epi8('\r'))));
+		separators = lineEnds | _mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (block, _mm_set1_epi8(' ')),
+			_mm_cmpeq_epi8 (block, _mm_set1_epi8('\t'))));
+		skip = __builtin_ctz (~separators);
+		if (lineEnds & ((1u<<skip)-1))
+			*lineEnd = true;
+		p += skip;
+		if (skip < 16)
+			return p;
+	}
+#endif
+	while (p < limit && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+	{
+		if (*p == '\n' || *p == '\r')
+			*lineEnd = true;
+		p++;
+	}
+	return p;
+}
+
+int isSpace (int c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
 int readInteger()
 {
-	char s[20]; // int can't be this long
-	int i=0;
-	int result, count;
+	long long result = 0;
+	int digits = 0, negative = false;
 	
 	while (ch >= 0 && ch != '-' && !isDigit(ch))
 	{
-		while (ch == ' ')
+		while (ch == ' ' || ch == '\t')
 			nextCh();
 		if (ch == '\n' || ch == '\r')
 		{
-			while (ch == '\n' || ch == '\r')
+			while (isSpace(ch))
 				nextCh();
 			skipComments();
 		}
+		else if (ch >= 0 && ch != '-' && !isDigit(ch))
+			break;
 	}
 	if (ch == '-')
 	{
-		s[i++] = ch;
+		negative = true;
+		nextCh();
+	}
+	if (isDigit(ch))
+	{
+		inputNext = scanDigits (inputNext-1, inputLimit, &result, &digits);
 		nextCh();
 	}
-	while (isDigit(ch) && i<19)
+	while (isDigit(ch) && digits <= 10)
 	{
-		s[i++] = ch;
+		result = result*10 + (ch - '0');
+		digits++;
 		nextCh();
 	}
-	s[i] = '\0';
-	count = sscanf (s, "%d", &result);
-	if (count != 1)
+	if (digits == 0 || result > INT_MAX)
 	{
-		fprintf (outFile, "c Could not parse <%s> as in integer\n", s);
+		if (ch < 0)
+			fprintf (outFile, "c Could not parse an integer at end of input\n");
+		else
+			fprintf (outFile, "c Could not parse an integer at <%c>\n", ch);
 		printFinal (STATUS_SYNTAX_ERROR);
 	}
 	
-	return result;
+	return negative ? -result : result;
 	
 }
 
@@ -938,8 +1625,126 @@ ClausePtr newClause()
 	return result;
 }
 
+/* Clauses read from the input keep their literals in one arena. While a store
+   is being filled it only records where each clause starts in the arena;
+   sealClauseStore then makes the Clause records for all of them in a single
+   array and points clauses[] at them. Clauses made later by newClause are
+   allocated individually and only those are released by freeClause. */
+
+typedef struct ClauseStoreStruct
+{
+	int *lits;
+	size_t numLits, litsCapacity;
+	size_t *offsets;
+	int numClauses, capacity;
+	Clause *records;
+	int numRecords;
+} ClauseStore, *ClauseStorePtr;
+
+ClauseStore clauseStore;
+
+void initClauseStore (ClauseStorePtr store, size_t litsCapacity, int capacity)
+{
+	store->litsCapacity = (litsCapacity > 16) ? litsCapacity : 16;
+	store->lits = checkMalloc (store->litsCapacity*sizeof(int), "storelits");
+	store->numLits = 0;
+	store->capacity = (capacity > 16) ? capacity : 16;
+	store->offsets = checkMalloc ((store->capacity+1)*sizeof(size_t), "storeoffsets");
+	store->offsets[0] = 0;
+	store->numClauses = 0;
+	store->records = NULL;
+	store->numRecords = 0;
+}
+
+void freeClauseStore (ClauseStorePtr store)
+{
+	if (store->lits != NULL)
+		checkFree (store->lits);
+	if (store->offsets != NULL)
+		checkFree (store->offsets);
+	if (store->records != NULL)
+		checkFree (store->records);
+	store->lits = NULL;
+	store->offsets = NULL;
+	store->records = NULL;
+	store->numRecords = 0;
+}
+
+/* Returns space in the arena for the literals of a new clause of the given
+   length. */
+int *addStoreClause (ClauseStorePtr store, int length)
+{
+	int *result;
+	
+	if (store->numLits + length > store->litsCapacity)
+	{
+		while (store->numLits + length > store->litsCapacity)
+			store->litsCapacity *= 2;
+		store->lits = checkRealloc (store->lits, store->litsCapacity*sizeof(int), "storelits");
+	}
+	if (store->numClauses == store->capacity)
+	{
+		store->capacity *= 2;
+		store->offsets = checkRealloc (store->offsets, (store->capacity+1)*sizeof(size_t), "storeoffsets");
+	}
+	result = store->lits + store->numLits;
+	store->numLits += length;
+	store->offsets[++store->numClauses] = store->numLits;
+	return result;
+}
+
+/* Appends the first count clauses of src to dest. */
+void appendClauseStore (ClauseStorePtr dest, ClauseStorePtr src, int count)
+{
+	size_t numLits = src->offsets[count];
+	int c;
+	
+	if (dest->numLits + numLits > dest->litsCapacity)
+	{
+		dest->litsCapacity = dest->numLits + numLits;
+		dest->lits = checkRealloc (dest->lits, dest->litsCapacity*sizeof(int), "storelits");
+	}
+	if (dest->numClauses + count > dest->capacity)
+	{
+		dest->capacity = dest->numClauses + count;
+		dest->offsets = checkRealloc (dest->offsets, (dest->capacity+1)*sizeof(size_t), "storeoffsets");
+	}
+	memcpy (dest->lits + dest->numLits, src->lits, numLits*sizeof(int));
+	for (c=1; c<=count; c++)
+		dest->offsets[dest->numClauses+c] = dest->numLits + src->offsets[c];
+	dest->numLits += numLits;
+	dest->numClauses += count;
+}
+
+void sealClauseStore (ClauseStorePtr store)
+{
+	ClausePtr clause;
+	int c;
+	
+	store->records = checkMalloc ((store->numClauses+1)*sizeof(Clause), "clauserecords");
+	store->numRecords = store->numClauses;
+	for (c=0; c<store->numClauses; c++)
+	{
+		clause = &store->records[c];
+		clause->lits = store->lits + store->offsets[c];
+		clause->length = store->offsets[c+1] - store->offsets[c];
+		clause->redundant = false;
+		clause->posAdded = -1;
+		clauses[numClauses++] = clause;
+	}
+	checkFree (store->offsets);
+	store->offsets = NULL;
+}
+
+int isStoreClause (ClausePtr clause)
+{
+	return clause >= clauseStore.records && clause < clauseStore.records + clauseStore.numRecords;
+}
+
 void freeClause (ClausePtr clause)
 {
+	if (isStoreClause (clause))
+		return;
 	if (clause->lits != NULL)
 		checkFree (clause->lits);
 	checkFree (clause);
@@ -982,53 +1787,425 @@ int litCompare (const void * a, const void * b)
 		return 0;
 }
 
-ClausePtr readClause()
+/* Long clauses are normalised in one pass over their literals using a mark
+   per variable holding the number of the clause that last used it and the
+   sign it was used with, and then radix sorted. Each parsing thread has its
+   own Normaliser. */
+
+#define NORMALISE_TAUTOLOGY	-1
+#define NORMALISE_OUT_OF_RANGE	-2
+#define INSERTION_SORT_LITS	32
+
+typedef struct NormaliserStruct
 {
-	ClausePtr result;
-	int p1,p2,lit,length;
-	int redundantClause = 0, redundantLit;
-	result = newClause();
+	unsigned int *marks, stamp;
+	int *scratch, scratchCapacity;
+} Normaliser, *NormaliserPtr;
+
+Normaliser normaliser;
+
+void initNormaliser (NormaliserPtr n)
+{
+	n->marks = checkMalloc ((1+originalNumVars)*sizeof(unsigned int), "marks");
+	memset (n->marks, 0, (1+originalNumVars)*sizeof(unsigned int));
+	n->stamp = 0;
+	n->scratchCapacity = 0;
+	n->scratch = NULL;
+}
+
+void freeNormaliser (NormaliserPtr n)
+{
+	if (n->marks != NULL)
+		checkFree (n->marks);
+	if (n->scratch != NULL)
+		checkFree (n->scratch);
+	n->marks = NULL;
+	n->scratch = NULL;
+	n->scratchCapacity = 0;
+}
+
+/* Sorts literals into litCompare order by an LSD radix sort on 2*var+sign,
+   one byte at a time. */
+void radixSortLits (NormaliserPtr n, int *lits, int length)
+{
+	unsigned int *codes, *temp, *swap, maxCode;
+	int counts[256], i, b, shift;
+	
+	if (n->scratchCapacity < 2*length)
+	{
+		if (n->scratch != NULL)
+			checkFree (n->scratch);
+		n->scratchCapacity = 2*length;
+		n->scratch = checkMalloc (n->scratchCapacity*sizeof(int), "scratch");
+	}
+	codes = (unsigned int *) n->scratch;
+	temp = codes + length;
+	
+	maxCode = 0;
+	for (i=0; i<length; i++)
+	{
+		codes[i] = LIT2CODE(lits[i]);
+		if (codes[i] > maxCode)
+			maxCode = codes[i];
+	}
+	
+	for (shift=0; shift<32 && (maxCode >> shift) != 0; shift+=8)
+	{
+		memset (counts, 0, sizeof(counts));
+		for (i=0; i<length; i++)
+			counts[(codes[i] >> shift) & 0xFF]++;
+		for (b=0, i=0; b<256; b++)
+		{
+			i += counts[b];
+			counts[b] = i - counts[b];
+		}
+		for (i=0; i<length; i++)
+			temp[counts[(codes[i] >> shift) & 0xFF]++] = codes[i];
+		swap = codes; codes = temp; temp = swap;
+	}
+	
+	for (i=0; i<length; i++)
+		lits[i] = CODE2LIT(codes[i]);
+}
+
+/* Sorts literals into litCompare order, needing only the scratch space of
+   the Normaliser. */
+void sortLits (NormaliserPtr n, int *lits, int length)
+{
+	int p1,p2,lit;
+	
+	if (length > INSERTION_SORT_LITS)
+		radixSortLits (n, lits, length);
+	else
+	{
+		for (p1=1; p1<length; p1++)
+		{
+			lit = lits[p1];
+			for (p2=p1; p2>0 && litCompare (&lits[p2-1], &lit) > 0; p2--)
+				lits[p2] = lits[p2-1];
+			lits[p2] = lit;
+		}
+	}
+}
+
+/* Sorts length literals in place and removes duplicates. Returns the new
+   length, NORMALISE_TAUTOLOGY if the clause contains a literal and its
+   negation, or NORMALISE_OUT_OF_RANGE if a variable is larger than the
+   number in the problem line. */
+int normaliseClause (NormaliserPtr n, int *lits, int length)
+{
+	int p1,p2,lit,var,newLength;
+	unsigned int mark;
+	
+	if (length <= INSERTION_SORT_LITS)
+	{
+		/* short clauses are sorted first, which brings duplicates and clashes together */
+		for (p1=0; p1<length; p1++)
+		{
+			lit = lits[p1];
+			if (abs(lit) > originalNumVars)
+				return NORMALISE_OUT_OF_RANGE;
+			for (p2=p1; p2>0 && litCompare (&lits[p2-1], &lit) > 0; p2--)
+				lits[p2] = lits[p2-1];
+			lits[p2] = lit;
+		}
+		newLength = 0;
+		for (p1=0; p1<length; p1++)
+		{
+			if (newLength > 0 && lits[newLength-1] == -lits[p1])
+				return NORMALISE_TAUTOLOGY;
+			if (newLength == 0 || lits[newLength-1] != lits[p1])
+				lits[newLength++] = lits[p1];
+		}
+		return newLength;
+	}
+	
+	if (n->stamp == UINT_MAX/2)
+	{
+		memset (n->marks, 0, (1+originalNumVars)*sizeof(unsigned int));
+		n->stamp = 0;
+	}
+	n->stamp++;
+	
+	newLength = 0;
+	for (p1=0; p1<length; p1++)
+	{
+		lit = lits[p1];
+		var = abs(lit);
+		if (var > originalNumVars)
+			return NORMALISE_OUT_OF_RANGE;
+		mark = 2*n->stamp + (lit > 0);
+		if ((n->marks[var] >> 1) == n->stamp)
+		{
+			if (n->marks[var] != mark)
+			{
+				/* clause with clashing lits is immediately satisfied */
+				return NORMALISE_TAUTOLOGY;
+			}
+			continue;
+		}
+		n->marks[var] = mark;
+		lits[newLength++] = lit;
+	}
+	
+	radixSortLits (n, lits, newLength);
+	
+	return newLength;
+}
+
+/* Adds a clause to the store unless normaliseClause rejects it, and returns
+   the result of normaliseClause. */
+int storeClause (ClauseStorePtr store, NormaliserPtr n, int *lits, int length)
+{
+	length = normaliseClause (n, lits, length);
+	if (length >= 0)
+		memcpy (addStoreClause (store, length), lits, length*sizeof(int));
+	return length;
+}
+
+/* Copies the clauses into a new arena in their current order, so that they
+   lie in memory in the order in which they are used, and frees the space of
+   the clauses which are no longer in clauses[]. */
+void compactClauses()
+{
+	ClauseStore oldStore = clauseStore;
+	ClausePtr clause;
+	size_t numLits;
+	int c, *lits;
+	
+	numLits = 0;
+	for (c=0; c<numClauses; c++)
+		numLits += clauses[c]->length;
+	initClauseStore (&clauseStore, numLits, numClauses);
+	for (c=0; c<numClauses; c++)
+	{
+		clause = clauses[c];
+		lits = addStoreClause (&clauseStore, clause->length);
+		memcpy (lits, clause->lits, clause->length*sizeof(int));
+		if (!(clause >= oldStore.records && clause < oldStore.records + oldStore.numRecords))
+			freeClause (clause);
+	}
+	numClauses = 0;
+	sealClauseStore (&clauseStore);
+	freeClauseStore (&oldStore);
+}
+
+int litsCapacity;
+
+void readClause()
+{
+	int p1,lit;
 	p1 = 0;
 	do
 	{
 		lit = readInteger();
 		if (lit != 0)
 		{
-			redundantLit = 0;
-			for (p2=0; p2<p1; p2++)
-				if (litsBuffer[p2] == -lit)
-				{
-					/* clause with clashing lits is immediately satisfied */
-					redundantClause = 1;
-				}
-				else if (litsBuffer[p2] == lit)
-					redundantLit = 1;
-				
-			if (!redundantLit)
+			if (p1 == litsCapacity)
 			{
-				litsBuffer[p1++] = lit;
+				litsCapacity *= 2;
+				litsBuffer = checkRealloc (litsBuffer, litsCapacity*sizeof(int), "litsbuffer");
 			}
+			litsBuffer[p1++] = lit;
 		}
 	} while (lit != 0);
 	
-	if (redundantClause)
+	if (storeClause (&clauseStore, &normaliser, litsBuffer, p1) == NORMALISE_OUT_OF_RANGE)
 	{
-		freeClause (result);
-		return NULL;
+		fprintf (outFile, "c Literal out of range\n");
+		printFinal (STATUS_SYNTAX_ERROR);
 	}
 	
-	length = p1;
-	result->lits = checkMalloc (length*sizeof(int), "lits");
+}
+
+/* When the whole input is in memory the clause section can be split at
+   clause boundaries and tokenized by several threads. Each chunk keeps the
+   clauses it reads in its own store, in input order, together with the
+   positions among them of the tautologies it dropped, so that they can be
+   merged into the clause store exactly as the sequential reader would fill
+   it. */
+
+typedef struct ParseChunkStruct
+{
+	char *start, *limit;
+	int *litsBuffer, litsCapacity;
+	ClauseStore store;
+	int *tautologies, numTautologies, tautologiesCapacity;
+	Normaliser normaliser;
+	int syntaxError, errorCh, outOfRange, started;
+	pthread_t thread;
+} ParseChunk, *ParseChunkPtr;
+
+#define MIN_PARALLEL_PARSE_BYTES (1<<20)
+
+/* Returns the start of the first line after p which follows a line ending
+   with a clause terminator, or limit if there is none. */
+char *nextClauseBoundary (char *p, char *start, char *limit)
+{
+	char *q, *lineStart;
 	
-	qsort (litsBuffer, length, sizeof(int), litCompare);
+	while (p < limit)
+	{
+		while (p < limit && *p != '\n')
+			p++;
+		if (p == limit)
+			return limit;
+		
+		q = p;
+		while (q > start && (q[-1] == ' ' || q[-1] == '\t' || q[-1] == '\r'))
+			q--;
+		if (q > start && q[-1] == '0' && (q-1 == start || isSpace(q[-2]) || q[-2] == '-'))
+		{
+			for (lineStart = q-1; lineStart > start && lineStart[-1] != '\n'; lineStart--);
+			while (lineStart < q && (*lineStart == ' ' || *lineStart == '\t'))
+				lineStart++;
+			if (*lineStart != 'c')
+				return p+1;
+		}
+		p++;
+	}
+	return limit;
+}
+
+void *parseChunk (void *arg)
+{
+	ParseChunkPtr chunk = (ParseChunkPtr) arg;
+	char *p = chunk->start, *limit = chunk->limit;
+	int lit, length = 0, digits, negative, atLineStart = true, result;
+	long long value;
 	
-	result->length = 0;
-	for (p1=0; p1<length; p1++)
-		if (p1==0 || litsBuffer[p1-1] != litsBuffer[p1]) // check for duplicate lits
-			result->lits[result->length++] = litsBuffer[p1];
+	chunk->litsCapacity = 64;
+	chunk->litsBuffer = checkMalloc (chunk->litsCapacity*sizeof(int), "chunklits");
+	initClauseStore (&chunk->store, (limit-p)/4, (limit-p)/16);
+	chunk->tautologiesCapacity = 16;
+	chunk->tautologies = checkMalloc (chunk->tautologiesCapacity*sizeof(int), "chunktautologies");
+	chunk->numTautologies = 0;
+	initNormaliser (&chunk->normaliser);
+	chunk->syntaxError = false;
+	chunk->outOfRange = false;
 	
-	return result;
+	while (true)
+	{
+		p = skipSeparators (p, limit, &atLineStart);
+		if (p == limit)
+			break;
+		if (*p == 'c' && atLineStart)
+		{
+			while (p < limit && *p != '\n' && *p != '\r')
+				p++;
+			continue;
+		}
+		atLineStart = false;
+		
+		negative = (*p == '-');
+		if (negative)
+			p++;
+		p = scanDigits (p, limit, &value, &digits);
+		if (digits == 0 || value > INT_MAX)
+		{
+			chunk->syntaxError = true;
+			chunk->errorCh = (p < limit) ? (unsigned char) *p : EOF;
+			break;
+		}
+		lit = negative ? -value : value;
+		
+		if (lit != 0)
+		{
+			if (length == chunk->litsCapacity)
+			{
+				chunk->litsCapacity *= 2;
+				chunk->litsBuffer = checkRealloc (chunk->litsBuffer, chunk->litsCapacity*sizeof(int), "chunklits");
+			}
+			chunk->litsBuffer[length++] = lit;
+		}
+		else
+		{
+			result = storeClause (&chunk->store, &chunk->normaliser, chunk->litsBuffer, length);
+			if (result == NORMALISE_OUT_OF_RANGE)
+			{
+				chunk->syntaxError = true;
+				chunk->outOfRange = true;
+				break;
+			}
+			else if (result == NORMALISE_TAUTOLOGY)
+			{
+				if (chunk->numTautologies == chunk->tautologiesCapacity)
+				{
+					chunk->tautologiesCapacity *= 2;
+					chunk->tautologies = checkRealloc (chunk->tautologies, chunk->tautologiesCapacity*sizeof(int), "chunktautologies");
+				}
+				chunk->tautologies[chunk->numTautologies] = chunk->store.numClauses + chunk->numTautologies;
+				chunk->numTautologies++;
+			}
+			length = 0;
+		}
+	}
 	
+	checkFree (chunk->litsBuffer);
+	freeNormaliser (&chunk->normaliser);
+	return NULL;
+}
+
+void parseClauseSection (char *start, char *limit)
+{
+	ParseChunkPtr chunks, chunk;
+	int numChunks, t, c, numRead, count;
+	char *p;
+	
+	numChunks = numThreads;
+	if (numChunks < 1 || limit-start < MIN_PARALLEL_PARSE_BYTES)
+		numChunks = 1;
+	chunks = checkMalloc (numChunks*sizeof(ParseChunk), "chunks");
+	
+	p = start;
+	for (t=0; t<numChunks; t++)
+	{
+		chunks[t].start = p;
+		if (t == numChunks-1)
+			p = limit;
+		else if (p < start + (limit-start)/numChunks*(t+1))
+			p = nextClauseBoundary (start + (limit-start)/numChunks*(t+1), start, limit);
+		chunks[t].limit = p;
+	}
+	
+	for (t=1; t<numChunks; t++)
+		chunks[t].started = pthread_create (&chunks[t].thread, NULL, parseChunk, &chunks[t]) == 0;
+	parseChunk (&chunks[0]);
+	for (t=1; t<numChunks; t++)
+		if (chunks[t].started)
+			pthread_join (chunks[t].thread, NULL);
+		else
+			parseChunk (&chunks[t]);
+	
+	numRead = 0;
+	for (t=0; t<numChunks; t++)
+	{
+		chunk = &chunks[t];
+		count = chunk->store.numClauses + chunk->numTautologies;
+		if (count > originalNumClauses - numRead)
+		{
+			/* only the clauses before the quota is reached are kept */
+			count = originalNumClauses - numRead;
+			for (c=0; c<chunk->numTautologies && chunk->tautologies[c] < count; c++);
+			appendClauseStore (&clauseStore, &chunk->store, count - c);
+		}
+		else
+			appendClauseStore (&clauseStore, &chunk->store, chunk->store.numClauses);
+		numRead += count;
+		if (numRead < originalNumClauses && (chunk->syntaxError || t == numChunks-1))
+		{
+			if (chunk->outOfRange)
+				fprintf (outFile, "c Literal out of range\n");
+			else if (!chunk->syntaxError || chunk->errorCh < 0)
+				fprintf (outFile, "c Could not parse an integer at end of input\n");
+			else
+				fprintf (outFile, "c Could not parse an integer at <%c>\n", chunk->errorCh);
+			printFinal (STATUS_SYNTAX_ERROR);
+		}
+		freeClauseStore (&chunk->store);
+		checkFree (chunk->tautologies);
+	}
+	checkFree (chunks);
 }
 
 void fprintClause (FILE *f, ClausePtr c)
@@ -1052,74 +2229,393 @@ void readProblemLine()
 }
 
 
-void readProposition()
+void initProposition()
 {
-	int c,p;
-	ClausePtr clause, clause1;
-	int newNumClauses;
-	
-	nextCh();
-	skipComments();
-	readProblemLine();
 	fprintf (outFile, "c o INITIAL-VARIABLES=%d\n", originalNumVars); fflush(stdout);
 	fprintf (outFile, "c o INITIAL-CLAUSES=%d\n", originalNumClauses); fflush(stdout);
 	if ( (traceLevel & competitionTrace) > 0) { fprintf (outFile, "ce Initially %d variables and %d clauses\n", originalNumVars, originalNumClauses);fflush(outFile);}
 
-	litsBuffer = checkMalloc (originalNumVars*sizeof(int), "litsbuffer");
 	clauses = checkMalloc (originalNumClauses*sizeof(ClausePtr), "clauses");
 	numClauses = 0;
 	numVars = originalNumVars;
+}
+
+void readDimacsClauses()
+{
+	int c;
+	
+	openInput();
+	nextCh();
+	skipComments();
+	readProblemLine();
+	initProposition();
+
+	litsCapacity = originalNumVars+16;
+	litsBuffer = checkMalloc (litsCapacity*sizeof(int), "litsbuffer");
+	initClauseStore (&clauseStore, 4*(size_t)originalNumClauses, originalNumClauses);
+	initNormaliser (&normaliser);
 	
-	for (c=0; c<originalNumClauses; c++)
+	if (inputMapped)
+		parseClauseSection ((ch >= 0) ? inputNext-1 : inputLimit, inputLimit);
+	else
 	{
-		clause = readClause();
-		if (clause != NULL)
-			clauses[numClauses++] = clause;
+		for (c=0; c<originalNumClauses; c++)
+			readClause();
 	}
-		
+	sealClauseStore (&clauseStore);
+	
+	freeNormaliser (&normaliser);
+	checkFree (litsBuffer);
+	closeInput();
+}
 
-	if ((traceLevel & fullClausesTrace))
+/* A varint is at most 5 bytes, and the fifth holds only the top 4 bits of
+   the 32; anything longer or larger is rejected. */
+unsigned int getVarint (unsigned char **p, unsigned char *limit)
+{
+	unsigned int result = 0;
+	int shift = 0;
+	
+	while (*p < limit && (**p & 0x80) != 0 && shift < 28)
 	{
-		fprintf (outFile, "ce Initially %d variables and %d clauses\n", originalNumVars, originalNumClauses);
-		fprintf (outFile, "ce Now %d variables and %d clauses\n", numVars, numClauses);
-		for (c=0; c<numClauses; c++)
+		result |= (unsigned int) (**p & 0x7F) << shift;
+		shift += 7;
+		(*p)++;
+	}
+	if (*p == limit || (**p & 0x80) != 0 || (shift == 28 && **p > 0x0F))
+	{
+		fprintf (outFile, "c Binary input is truncated or corrupt\n");
+		printFinal (STATUS_SYNTAX_ERROR);
+	}
+	result |= (unsigned int) **p << shift;
+	(*p)++;
+	return result;
+}
+
+BinaryHeader *checkBinaryProposition (char *data, size_t size)
+{
+	BinaryHeader *header;
+	
+	header = (BinaryHeader *) data;
+	/* every clause takes at least the byte of its length */
+	if (size < sizeof(BinaryHeader) || memcmp (header->magic, BINARY_MAGIC, sizeof(header->magic)) != 0 ||
+		header->numClauses > header->headerClauses || header->numVars > INT_MAX || header->headerClauses > INT_MAX ||
+		header->payloadSize != size - sizeof(BinaryHeader) || header->numClauses > header->payloadSize)
+		return NULL;
+	return header;
+}
+
+void decodeBinaryClauses (BinaryHeader *header)
+{
+	unsigned char *p, *limit;
+	unsigned int c, i, code, delta, length;
+	int *lits;
+	
+	p = (unsigned char *) (header + 1);
+	limit = p + header->payloadSize;
+	initClauseStore (&clauseStore, header->payloadSize, header->numClauses);
+	
+	for (c=0; c<header->numClauses; c++)
+	{
+		length = getVarint (&p, limit);
+		if (length > (size_t) (limit - p))
 		{
-			fprintClause (outFile, clauses[c]);
-			fprintf (outFile, "\n");
+			fprintf (outFile, "c Binary input is truncated or corrupt\n");
+			printFinal (STATUS_SYNTAX_ERROR);
 		}
+		lits = addStoreClause (&clauseStore, length);
+		code = 0;
+		for (i=0; i<length; i++)
+		{
+			delta = getVarint (&p, limit);
+			code += delta;
+			lits[i] = CODE2LIT(code);
+			if (code < 2 || code/2 > header->numVars || (i > 0 && (delta == 0 || code < delta || (code-delta)/2 == code/2)))
+			{
+				fprintf (outFile, "c Binary input is truncated or corrupt\n");
+				printFinal (STATUS_SYNTAX_ERROR);
+			}
+		}
+	}
+	if (p != limit)
+	{
+		fprintf (outFile, "c Binary input is truncated or corrupt\n");
+		printFinal (STATUS_SYNTAX_ERROR);
 	}
+	sealClauseStore (&clauseStore);
+}
 
-	for (c=0;c<numClauses;c++)
+void readBinaryClauses()
+{
+	struct stat st;
+	char *data;
+	BinaryHeader *header;
+	
+	data = MAP_FAILED;
+	if (fstat (fileno(inFile), &st) == 0 && st.st_size > 0)
+		data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(inFile), 0);
+	if (data == MAP_FAILED)
 	{
-		clause = clauses[c];
-		qsort (clause->lits, clause->length, sizeof(int), litCompare);
+		fprintf (outFile, "c Could not map binary input\n");
+		printFinal (STATUS_SYNTAX_ERROR);
 	}
+	header = checkBinaryProposition (data, st.st_size);
+	if (header == NULL)
+	{
+		fprintf (outFile, "c Binary input is truncated or corrupt\n");
+		printFinal (STATUS_SYNTAX_ERROR);
+	}
+	
+	originalNumVars = header->numVars;
+	originalNumClauses = header->headerClauses;
+	initProposition();
+	decodeBinaryClauses (header);
+	
+	munmap (data, st.st_size);
+}
 
-	qsort (clauses, numClauses, sizeof (ClausePtr), clauseCompare);
+void writeConvertedProposition()
+{
+	FILE *f;
 	
-	if (numClauses > 0)
+	if (writeBinaryName != NULL)
 	{
-		newNumClauses = 1;
+		f = fopen (writeBinaryName, "wb");
+		if (f == NULL)
+		{
+			fprintf (outFile, "c o CANT-OPEN=<%s>\n", writeBinaryName);
+			exit (1);
+		}
+		fwriteBinaryProposition (f, originalNumVars, originalNumClauses, numClauses, clauses);
+		fclose (f);
+		fprintf (outFile, "c o WROTE-BINARY=<%s>\n", writeBinaryName);
+	}
+	if (writeDimacsName != NULL)
+	{
+		f = fopen (writeDimacsName, "w");
+		if (f == NULL)
+		{
+			fprintf (outFile, "c o CANT-OPEN=<%s>\n", writeDimacsName);
+			exit (1);
+		}
+		fprintProposition (f, originalNumVars, numClauses, clauses);
+		fclose (f);
+		fprintf (outFile, "c o WROTE-DIMACS=<%s>\n", writeDimacsName);
+	}
+	fflush (outFile);
+	exit (0);
+}
+
+/* Sorts clauses[] into clauseCompare order. The clauses are first put into
+   buckets by their first literal with a counting sort, and the buckets are
+   then shared out between the threads. Within a bucket the clauses are
+   radix sorted on their literal at each depth in turn, a clause which has
+   ended sorting after every literal as in clauseCompare. */
 
-		c = 1;
-		while (c < numClauses)
+#define RADIX_SORT_MIN_CLAUSES 64
+#define RADIX_SORT_MAX_DEPTH 64
+#define MIN_PARALLEL_SORT_CLAUSES (1<<16)
+
+unsigned int clauseKey (ClausePtr clause, int depth)
+{
+	return (depth < clause->length) ? (unsigned int) LIT2CODE(clause->lits[depth]) : UINT_MAX;
+}
+
+void radixSortClauses (ClausePtr *cs, ClausePtr *temp, int n, int depth)
+{
+	int counts[4][256], b, i, start, shift, pass, oneGroup;
+	unsigned int key;
+	
+	while (n > 1)
+	{
+		if (n < RADIX_SORT_MIN_CLAUSES || depth > RADIX_SORT_MAX_DEPTH)
 		{
-			while (c < numClauses && clauseCompare(&clauses[c],&clauses[newNumClauses-1])==0) c++;
-			if (c < numClauses) clauses[newNumClauses++] = clauses[c++];
+			qsort (cs, n, sizeof (ClausePtr), clauseCompare);
+			return;
 		}
 		
-		if (newNumClauses < numClauses)
+		memset (counts, 0, sizeof(counts));
+		for (i=0; i<n; i++)
 		{
-			fprintf (outFile, "c o DUPLICATE-CLAUSES=%d\n", numClauses-newNumClauses);
-			numClauses = newNumClauses;
+			key = clauseKey (cs[i], depth);
+			for (pass=0; pass<4; pass++)
+				counts[pass][(key >> (8*pass)) & 0xFF]++;
+		}
+		for (pass=0; pass<4; pass++)
+		{
+			shift = 8*pass;
+			if (counts[pass][(clauseKey (cs[0], depth) >> shift) & 0xFF] == n)
+				continue;
+			for (b=0, i=0; b<256; b++)
+			{
+				i += counts[pass][b];
+				counts[pass][b] = i - counts[pass][b];
+			}
+			for (i=0; i<n; i++)
+				temp[counts[pass][(clauseKey (cs[i], depth) >> shift) & 0xFF]++] = cs[i];
+			memcpy (cs, temp, n*sizeof(ClausePtr));
 		}
 		
+		/* clauses with the same literal here are sorted on the next one */
+		oneGroup = false;
+		for (start=0; start<n; start=i)
+		{
+			key = clauseKey (cs[start], depth);
+			for (i=start+1; i<n && clauseKey (cs[i], depth) == key; i++);
+			if (start == 0 && i == n)
+				oneGroup = true;
+			else if (key != UINT_MAX && i-start > 1)
+				radixSortClauses (cs+start, temp+start, i-start, depth+1);
+		}
+		if (!oneGroup || clauseKey (cs[0], depth) == UINT_MAX)
+			return;
+		depth++;
+	}
+}
+
+typedef struct SortJobStruct
+{
+	ClausePtr *cs, *temp;
+	int *bucketStarts;
+	unsigned int numBuckets, nextBucket;
+} SortJob, *SortJobPtr;
+
+void *sortBuckets (void *arg)
+{
+	SortJobPtr job = (SortJobPtr) arg;
+	unsigned int b;
+	int start, size;
 	
+	while ((b = __sync_fetch_and_add (&job->nextBucket, 1)) < job->numBuckets)
+	{
+		start = job->bucketStarts[b];
+		size = job->bucketStarts[b+1] - start;
+		if (size > 1 && b < job->numBuckets-1)
+			radixSortClauses (job->cs+start, job->temp+start, size, 1);
 	}
+	return NULL;
+}
 
+void sortClauses()
+{
+	SortJob job;
+	pthread_t *threads;
+	int *started, c, t, numThreadsUsed;
+	unsigned int b, key;
+	
+	if (numClauses < 2)
+		return;
+	
+	/* bucket numBuckets-1 holds any empty clauses, which sort last */
+	job.numBuckets = 2*numVars+3;
+	job.bucketStarts = checkMalloc ((job.numBuckets+1)*sizeof(int), "bucketstarts");
+	job.temp = checkMalloc (numClauses*sizeof(ClausePtr), "sorttemp");
+	job.cs = clauses;
+	job.nextBucket = 0;
+	
+	memset (job.bucketStarts, 0, (job.numBuckets+1)*sizeof(int));
+	for (c=0; c<numClauses; c++)
+	{
+		key = clauseKey (clauses[c], 0);
+		job.bucketStarts[(key == UINT_MAX) ? job.numBuckets-1 : key]++;
+	}
+	for (b=0, c=0; b<=job.numBuckets; b++)
+	{
+		c += job.bucketStarts[b];
+		job.bucketStarts[b] = c - job.bucketStarts[b];
+	}
+	for (c=0; c<numClauses; c++)
+	{
+		key = clauseKey (clauses[c], 0);
+		job.temp[job.bucketStarts[(key == UINT_MAX) ? job.numBuckets-1 : key]++] = clauses[c];
+	}
+	memcpy (clauses, job.temp, numClauses*sizeof(ClausePtr));
+	for (b=job.numBuckets; b>0; b--)
+		job.bucketStarts[b] = job.bucketStarts[b-1];
+	job.bucketStarts[0] = 0;
+	
+	numThreadsUsed = (numClauses < MIN_PARALLEL_SORT_CLAUSES) ? 1 : numThreads;
+	threads = checkMalloc (numThreadsUsed*sizeof(pthread_t), "sortthreads");
+	started = checkMalloc (numThreadsUsed*sizeof(int), "sortstarted");
+	for (t=1; t<numThreadsUsed; t++)
+		started[t] = pthread_create (&threads[t], NULL, sortBuckets, &job) == 0;
+	sortBuckets (&job);
+	for (t=1; t<numThreadsUsed; t++)
+		if (started[t])
+			pthread_join (threads[t], NULL);
+	
+	checkFree (threads);
+	checkFree (started);
+	checkFree (job.temp);
+	checkFree (job.bucketStarts);
+}
+
+/* Removes later copies of duplicate clauses, keeping the order of the rest,
+   using an open addressed table of clause numbers. */
+void removeDuplicateClauses()
+{
+	int *table, tableSize, c, newNumClauses;
+	unsigned long slot;
+	
+	for (tableSize=16; tableSize < 2*numClauses; tableSize*=2);
+	table = checkMalloc (tableSize*sizeof(int), "duplicatetable");
+	memset (table, -1, tableSize*sizeof(int));
+	
+	newNumClauses = 0;
+	for (c=0; c<numClauses; c++)
+	{
+		slot = (clauseHashFunction (clauses[c]) * 0x9E3779B97F4A7C15ULL) >> 32;
+		while (true)
+		{
+			slot &= tableSize-1;
+			if (table[slot] < 0)
+			{
+				table[slot] = newNumClauses;
+				clauses[newNumClauses++] = clauses[c];
+				break;
+			}
+			if (clauseCompare (&clauses[table[slot]], &clauses[c]) == 0)
+				break;
+			slot++;
+		}
+	}
+	checkFree (table);
+	
+	if (newNumClauses < numClauses)
+	{
+		fprintf (outFile, "c o DUPLICATE-CLAUSES=%d\n", numClauses-newNumClauses);
+		numClauses = newNumClauses;
+	}
+}
 
-	checkFree (litsBuffer);
+void readProposition()
+{
+	int c;
+	
+	if (inputBinary)
+		readBinaryClauses();
+	else
+		readDimacsClauses();
+	
+	if (writeBinaryName != NULL || writeDimacsName != NULL)
+		writeConvertedProposition();
 
+	if ((traceLevel & fullClausesTrace))
+	{
+		fprintf (outFile, "ce Initially %d variables and %d clauses\n", originalNumVars, originalNumClauses);
+		fprintf (outFile, "ce Now %d variables and %d clauses\n", numVars, numClauses);
+		for (c=0; c<numClauses; c++)
+		{
+			fprintClause (outFile, clauses[c]);
+			fprintf (outFile, "\n");
+		}
+	}
+
+	removeDuplicateClauses();
+	
+	/* otherwise sortSubProblems sorts them after renumbering the variables */
+	if (noReduce)
+		sortClauses();
 }
 
 void setUpVarToClause()
@@ -1154,107 +2650,836 @@ void freeVarToClause()
 
 }
 
-
-void remapClauses()
+
+/* Renames the variables of every clause and puts its literals back into
+   litCompare order. */
+void remapClauses()
+{
+	int c,v,sorted;
+	ClausePtr clause;
+	
+	for (c=0; c<numClauses; c++)
+	{
+		clause = clauses[c];
+		sorted = true;
+		for (v=0; v<clause->length; v++)
+		{
+			if (clause->lits[v] > 0)
+				clause->lits[v] = mapVariables[clause->lits[v]];
+			else
+				clause->lits[v] = -mapVariables[-clause->lits[v]];
+			if (v > 0 && sorted && litCompare (&clause->lits[v-1], &clause->lits[v]) > 0)
+				sorted = false;
+		}
+		if (!sorted)
+			sortLits (&normaliser, clause->lits, clause->length);
+	}
+	
+	if (variableMap == NULL)
+	{
+		variableMap = checkMalloc ((1+originalNumVars)*sizeof(int),"variablemap");
+		for (v=0; v<=originalNumVars; v++)
+			variableMap[v] = v;
+	}
+	for (v=1; v<=originalNumVars; v++)
+		if (variableMap[v] != 0)
+			variableMap[v] = mapVariables[variableMap[v]];
+}
+
+
+/* Occurrence lists of every literal, indexed by LIT2CODE, as clause numbers
+   held in one array. */
+int *occStart, *occClauses;
+
+void buildOccurrences()
+{
+	int c,p,code,*fill;
+	ClausePtr clause;
+	
+	occStart = checkMalloc ((2*numVars+3)*sizeof(int),"occstart");
+	memset (occStart, 0, (2*numVars+3)*sizeof(int));
+	for (c=0; c<numClauses; c++)
+	{
+		clause = clauses[c];
+		for (p=0; p<clause->length; p++)
+			occStart[LIT2CODE(clause->lits[p])+1]++;
+	}
+	for (code=1; code<2*numVars+3; code++)
+		occStart[code] += occStart[code-1];
+	
+	fill = checkMalloc ((2*numVars+2)*sizeof(int),"occfill");
+	memcpy (fill, occStart, (2*numVars+2)*sizeof(int));
+	occClauses = checkMalloc ((occStart[2*numVars+2]+1)*sizeof(int),"occclauses");
+	for (c=0; c<numClauses; c++)
+	{
+		clause = clauses[c];
+		for (p=0; p<clause->length; p++)
+			occClauses[fill[LIT2CODE(clause->lits[p])]++] = c;
+	}
+	checkFree (fill);
+}
+
+void freeOccurrences()
+{
+	checkFree (occStart);
+	checkFree (occClauses);
+}
+
+/* A small CDCL solver used to find literals which are true in every model.
+   Clauses are kept in one array of literals with two watched literals each,
+   the first two of the clause, and the reason for an implied literal is a
+   clause whose first literal it is. Learnt clauses are only dropped at a
+   restart, when everything above level 0 is undone and the watches can be
+   rebuilt from scratch. */
+
+#define SOLVER_SAT	1
+#define SOLVER_UNSAT	0
+#define SOLVER_UNKNOWN	-1
+#define SOLVER_RESTART_CONFLICTS	100
+#define SOLVER_MAX_LEARNTS	20000
+#define BACKBONE_CONFLICTS	1000
+
+typedef struct SolverStruct
+{
+	int numVars, unsat;
+	int *lits;
+	size_t numLits, litsCapacity;
+	size_t *clauseStart;
+	int *clauseLength;
+	int numClauses, numOriginal, clausesCapacity;
+	int **watches, *numWatches, *watchesCapacity;
+	int *value, *level, *reason, *phase, *seen, *model;
+	int *trail, trailSize, qhead;
+	int *trailLimit, decisionLevel;
+	double *activity, activityIncrement;
+	int *heap, heapSize, *heapPos;
+	int *learnt;
+	long conflicts;
+	double deadline;
+} Solver;
+
+Solver solver;
+
+#define SOLVERVALUE(l)	(((l)>0)?solver.value[l]:-solver.value[-(l)])
+
+void solverHeapUp (int i)
+{
+	int v = solver.heap[i], parent;
+	
+	while (i > 0)
+	{
+		parent = (i-1)/2;
+		if (solver.activity[solver.heap[parent]] >= solver.activity[v])
+			break;
+		solver.heap[i] = solver.heap[parent];
+		solver.heapPos[solver.heap[i]] = i;
+		i = parent;
+	}
+	solver.heap[i] = v;
+	solver.heapPos[v] = i;
+}
+
+void solverHeapDown (int i)
+{
+	int v = solver.heap[i], child;
+	
+	while ((child = 2*i+1) < solver.heapSize)
+	{
+		if (child+1 < solver.heapSize && solver.activity[solver.heap[child+1]] > solver.activity[solver.heap[child]])
+			child++;
+		if (solver.activity[solver.heap[child]] <= solver.activity[v])
+			break;
+		solver.heap[i] = solver.heap[child];
+		solver.heapPos[solver.heap[i]] = i;
+		i = child;
+	}
+	solver.heap[i] = v;
+	solver.heapPos[v] = i;
+}
+
+void solverHeapInsert (int v)
+{
+	if (solver.heapPos[v] >= 0)
+		return;
+	solver.heap[solver.heapSize] = v;
+	solver.heapPos[v] = solver.heapSize++;
+	solverHeapUp (solver.heapPos[v]);
+}
+
+int solverHeapRemoveMax()
+{
+	int v = solver.heap[0];
+	
+	solver.heapPos[v] = -1;
+	if (--solver.heapSize > 0)
+	{
+		solver.heap[0] = solver.heap[solver.heapSize];
+		solver.heapPos[solver.heap[0]] = 0;
+		solverHeapDown (0);
+	}
+	return v;
+}
+
+void solverBump (int v)
+{
+	if ((solver.activity[v] += solver.activityIncrement) > 1e100)
+	{
+		int w;
+		for (w=1; w<=solver.numVars; w++)
+			solver.activity[w] *= 1e-100;
+		solver.activityIncrement *= 1e-100;
+	}
+	if (solver.heapPos[v] >= 0)
+		solverHeapUp (solver.heapPos[v]);
+}
+
+void solverWatch (int lit, int c)
+{
+	int code = LIT2CODE(lit);
+	
+	if (solver.numWatches[code] == solver.watchesCapacity[code])
+	{
+		solver.watchesCapacity[code] = 2*solver.watchesCapacity[code] + 4;
+		solver.watches[code] = checkRealloc (solver.watches[code], solver.watchesCapacity[code]*sizeof(int), "watches");
+	}
+	solver.watches[code][solver.numWatches[code]++] = c;
+}
+
+void solverAssign (int lit, int reason)
+{
+	int v = abs(lit);
+	
+	solver.value[v] = (lit > 0) ? 1 : -1;
+	solver.level[v] = solver.decisionLevel;
+	solver.reason[v] = reason;
+	solver.trail[solver.trailSize++] = lit;
+}
+
+/* Returns the number of a new clause with the given literals, which are not
+   copied into the watches. */
+int solverStoreClause (int *lits, int length)
+{
+	int c = solver.numClauses;
+	
+	if (solver.numLits + length > solver.litsCapacity)
+	{
+		while (solver.numLits + length > solver.litsCapacity)
+			solver.litsCapacity *= 2;
+		solver.lits = checkRealloc (solver.lits, solver.litsCapacity*sizeof(int), "solverlits");
+	}
+	if (c == solver.clausesCapacity)
+	{
+		solver.clausesCapacity *= 2;
+		solver.clauseStart = checkRealloc (solver.clauseStart, solver.clausesCapacity*sizeof(size_t), "solverclausestart");
+		solver.clauseLength = checkRealloc (solver.clauseLength, solver.clausesCapacity*sizeof(int), "solverclauselength");
+	}
+	solver.clauseStart[c] = solver.numLits;
+	solver.clauseLength[c] = length;
+	memcpy (solver.lits + solver.numLits, lits, length*sizeof(int));
+	solver.numLits += length;
+	solver.numClauses++;
+	return c;
+}
+
+/* Adds a clause at level 0, where the solver must be. */
+void solverAddClause (int *lits, int length)
+{
+	int c;
+	
+	if (length == 0)
+		solver.unsat = true;
+	else if (length == 1)
+	{
+		if (SOLVERVALUE(lits[0]) < 0)
+			solver.unsat = true;
+		else if (SOLVERVALUE(lits[0]) == 0)
+			solverAssign (lits[0], -1);
+	}
+	else
+	{
+		c = solverStoreClause (lits, length);
+		solverWatch (lits[0], c);
+		solverWatch (lits[1], c);
+	}
+}
+
+void initSolver()
+{
+	int v,c,code;
+	
+	solver.numVars = numVars;
+	solver.unsat = false;
+	solver.litsCapacity = 16;
+	solver.clausesCapacity = 16;
+	for (c=0; c<numClauses; c++)
+		solver.litsCapacity += clauses[c]->length;
+	solver.clausesCapacity += numClauses;
+	solver.lits = checkMalloc (solver.litsCapacity*sizeof(int), "solverlits");
+	solver.clauseStart = checkMalloc (solver.clausesCapacity*sizeof(size_t), "solverclausestart");
+	solver.clauseLength = checkMalloc (solver.clausesCapacity*sizeof(int), "solverclauselength");
+	solver.numLits = 0;
+	solver.numClauses = 0;
+	
+	solver.watches = checkMalloc ((2*numVars+2)*sizeof(int *), "watches");
+	solver.numWatches = checkMalloc ((2*numVars+2)*sizeof(int), "numwatches");
+	solver.watchesCapacity = checkMalloc ((2*numVars+2)*sizeof(int), "watchescapacity");
+	for (code=0; code<2*numVars+2; code++)
+	{
+		solver.watches[code] = NULL;
+		solver.numWatches[code] = 0;
+		solver.watchesCapacity[code] = 0;
+	}
+	
+	solver.value = checkMalloc ((1+numVars)*sizeof(int), "solvervalue");
+	solver.level = checkMalloc ((1+numVars)*sizeof(int), "solverlevel");
+	solver.reason = checkMalloc ((1+numVars)*sizeof(int), "solverreason");
+	solver.phase = checkMalloc ((1+numVars)*sizeof(int), "solverphase");
+	solver.seen = checkMalloc ((1+numVars)*sizeof(int), "solverseen");
+	solver.model = checkMalloc ((1+numVars)*sizeof(int), "solvermodel");
+	solver.trail = checkMalloc ((1+numVars)*sizeof(int), "solvertrail");
+	solver.trailLimit = checkMalloc ((1+numVars)*sizeof(int), "solvertraillimit");
+	solver.activity = checkMalloc ((1+numVars)*sizeof(double), "solveractivity");
+	solver.heap = checkMalloc ((1+numVars)*sizeof(int), "solverheap");
+	solver.heapPos = checkMalloc ((1+numVars)*sizeof(int), "solverheappos");
+	solver.learnt = checkMalloc ((1+numVars)*sizeof(int), "solverlearnt");
+	solver.trailSize = 0;
+	solver.qhead = 0;
+	solver.decisionLevel = 0;
+	solver.heapSize = 0;
+	solver.activityIncrement = 1.0;
+	solver.conflicts = 0;
+	for (v=1; v<=numVars; v++)
+	{
+		solver.value[v] = 0;
+		solver.phase[v] = -1;
+		solver.seen[v] = false;
+		solver.activity[v] = 0.0;
+		solver.heapPos[v] = -1;
+		solverHeapInsert (v);
+	}
+	
+	for (c=0; c<numClauses && !solver.unsat; c++)
+		solverAddClause (clauses[c]->lits, clauses[c]->length);
+	solver.numOriginal = solver.numClauses;
+}
+
+void freeSolver()
+{
+	int code;
+	
+	for (code=0; code<2*solver.numVars+2; code++)
+		if (solver.watches[code] != NULL)
+			checkFree (solver.watches[code]);
+	checkFree (solver.watches);
+	checkFree (solver.numWatches);
+	checkFree (solver.watchesCapacity);
+	checkFree (solver.lits);
+	checkFree (solver.clauseStart);
+	checkFree (solver.clauseLength);
+	checkFree (solver.value);
+	checkFree (solver.level);
+	checkFree (solver.reason);
+	checkFree (solver.phase);
+	checkFree (solver.seen);
+	checkFree (solver.model);
+	checkFree (solver.trail);
+	checkFree (solver.trailLimit);
+	checkFree (solver.activity);
+	checkFree (solver.heap);
+	checkFree (solver.heapPos);
+	checkFree (solver.learnt);
+}
+
+/* Returns the number of a conflicting clause, or -1. */
+int solverPropagate()
+{
+	int falseLit,code,i,j,k,n,c,lit,*ws,*lits;
+	
+	while (solver.qhead < solver.trailSize)
+	{
+		falseLit = -solver.trail[solver.qhead++];
+		code = LIT2CODE(falseLit);
+		ws = solver.watches[code];
+		n = solver.numWatches[code];
+		for (i=0, j=0; i<n; )
+		{
+			c = ws[i++];
+			lits = solver.lits + solver.clauseStart[c];
+			if (lits[0] == falseLit)
+			{
+				lits[0] = lits[1];
+				lits[1] = falseLit;
+			}
+			if (SOLVERVALUE(lits[0]) > 0)
+			{
+				ws[j++] = c;
+				continue;
+			}
+			for (k=2; k<solver.clauseLength[c] && SOLVERVALUE(lits[k]) < 0; k++);
+			if (k < solver.clauseLength[c])
+			{
+				lit = lits[k];
+				lits[k] = falseLit;
+				lits[1] = lit;
+				solverWatch (lit, c);
+				continue;
+			}
+			ws[j++] = c;
+			if (SOLVERVALUE(lits[0]) < 0)
+			{
+				while (i < n)
+					ws[j++] = ws[i++];
+				solver.numWatches[code] = j;
+				return c;
+			}
+			solverAssign (lits[0], c);
+		}
+		solver.numWatches[code] = j;
+	}
+	return -1;
+}
+
+void solverNewLevel()
+{
+	solver.trailLimit[solver.decisionLevel++] = solver.trailSize;
+}
+
+void solverBacktrack (int level)
+{
+	int v;
+	
+	if (solver.decisionLevel <= level)
+		return;
+	while (solver.trailSize > solver.trailLimit[level])
+	{
+		v = abs(solver.trail[--solver.trailSize]);
+		solver.phase[v] = solver.value[v];
+		solver.value[v] = 0;
+		solverHeapInsert (v);
+	}
+	solver.qhead = solver.trailSize;
+	solver.decisionLevel = level;
+}
+
+/* First UIP learning. The learnt clause is left in solver.learnt with the
+   asserting literal first and a literal of the backtrack level second. */
+int solverAnalyse (int conflict, int *backtrackLevel)
+{
+	int pathCount = 0, lit = 0, length = 1, index = solver.trailSize-1;
+	int i,v,*lits,max;
+	
+	do
+	{
+		lits = solver.lits + solver.clauseStart[conflict];
+		for (i=(lit == 0) ? 0 : 1; i<solver.clauseLength[conflict]; i++)
+		{
+			v = abs(lits[i]);
+			if (!solver.seen[v] && solver.level[v] > 0)
+			{
+				solver.seen[v] = true;
+				solverBump (v);
+				if (solver.level[v] >= solver.decisionLevel)
+					pathCount++;
+				else
+					solver.learnt[length++] = lits[i];
+			}
+		}
+		while (!solver.seen[abs(solver.trail[index])])
+			index--;
+		lit = solver.trail[index--];
+		conflict = solver.reason[abs(lit)];
+		solver.seen[abs(lit)] = false;
+		pathCount--;
+	} while (pathCount > 0);
+	solver.learnt[0] = -lit;
+	
+	*backtrackLevel = 0;
+	max = 1;
+	for (i=1; i<length; i++)
+	{
+		solver.seen[abs(solver.learnt[i])] = false;
+		if (solver.level[abs(solver.learnt[i])] > *backtrackLevel)
+		{
+			*backtrackLevel = solver.level[abs(solver.learnt[i])];
+			max = i;
+		}
+	}
+	if (length > 1)
+	{
+		lit = solver.learnt[1];
+		solver.learnt[1] = solver.learnt[max];
+		solver.learnt[max] = lit;
+	}
+	solver.activityIncrement *= 1.05;
+	return length;
+}
+
+/* At level 0 the learnt clauses beyond the limit are dropped, keeping the
+   shorter half, and the watches are rebuilt. */
+void solverReduce()
+{
+	int c,code,length,newNumClauses,*lengths;
+	size_t numLits;
+	
+	if (solver.numClauses - solver.numOriginal <= SOLVER_MAX_LEARNTS)
+		return;
+	lengths = checkMalloc ((solver.numVars+2)*sizeof(int), "learntlengths");
+	memset (lengths, 0, (solver.numVars+2)*sizeof(int));
+	for (c=solver.numOriginal; c<solver.numClauses; c++)
+		lengths[solver.clauseLength[c]]++;
+	for (length=0, c=0; length <= solver.numVars && c + lengths[length] <= SOLVER_MAX_LEARNTS/2; length++)
+		c += lengths[length];
+	checkFree (lengths);
+	
+	numLits = solver.clauseStart[solver.numOriginal];
+	newNumClauses = solver.numOriginal;
+	for (c=solver.numOriginal; c<solver.numClauses; c++)
+	{
+		if (solver.clauseLength[c] >= length)
+			continue;
+		memmove (solver.lits + numLits, solver.lits + solver.clauseStart[c], solver.clauseLength[c]*sizeof(int));
+		solver.clauseStart[newNumClauses] = numLits;
+		solver.clauseLength[newNumClauses++] = solver.clauseLength[c];
+		numLits += solver.clauseLength[c];
+	}
+	solver.numClauses = newNumClauses;
+	solver.numLits = numLits;
+	for (c=0; c<solver.trailSize; c++)
+		solver.reason[abs(solver.trail[c])] = -1;
+	for (code=0; code<2*solver.numVars+2; code++)
+		solver.numWatches[code] = 0;
+	for (c=0; c<solver.numClauses; c++)
+	{
+		solverWatch (solver.lits[solver.clauseStart[c]], c);
+		solverWatch (solver.lits[solver.clauseStart[c]+1], c);
+	}
+}
+
+int luby (int i)
+{
+	int size, power;
+	
+	for (size=1, power=0; size < i+1; power++, size = 2*size+1);
+	while (size-1 != i)
+	{
+		size = (size-1)/2;
+		power--;
+		i = i % size;
+	}
+	return 1 << power;
+}
+
+/* Solves under the given assumptions, giving up after maxConflicts conflicts
+   or at the deadline. On SOLVER_SAT the model is left in solver.model. The
+   solver is always back at level 0 on return. */
+int solve (int *assumptions, int numAssumptions, long maxConflicts)
+{
+	int conflict, backtrackLevel, length, lit, v, c, restarts = 0;
+	long conflictsAtStart = solver.conflicts, restartLimit;
+	
+	if (solver.unsat)
+		return SOLVER_UNSAT;
+	restartLimit = solver.conflicts + SOLVER_RESTART_CONFLICTS*luby (restarts);
+	for (;;)
+	{
+		conflict = solverPropagate();
+		if (conflict >= 0)
+		{
+			solver.conflicts++;
+			if (solver.decisionLevel == 0)
+			{
+				solver.unsat = true;
+				return SOLVER_UNSAT;
+			}
+			length = solverAnalyse (conflict, &backtrackLevel);
+			solverBacktrack (backtrackLevel);
+			if (length == 1)
+				solverAssign (solver.learnt[0], -1);
+			else
+			{
+				c = solverStoreClause (solver.learnt, length);
+				solverWatch (solver.learnt[0], c);
+				solverWatch (solver.learnt[1], c);
+				solverAssign (solver.learnt[0], c);
+			}
+			
+			if (solver.conflicts - conflictsAtStart >= maxConflicts ||
+				((solver.conflicts & 15) == 0 && getCPUTimeSinceStart() > solver.deadline))
+			{
+				solverBacktrack (0);
+				return SOLVER_UNKNOWN;
+			}
+			if (solver.conflicts >= restartLimit)
+			{
+				solverBacktrack (0);
+				solverReduce();
+				restartLimit = solver.conflicts + SOLVER_RESTART_CONFLICTS*luby (++restarts);
+			}
+		}
+		else if (solver.decisionLevel < numAssumptions)
+		{
+			lit = assumptions[solver.decisionLevel];
+			if (SOLVERVALUE(lit) < 0)
+			{
+				solverBacktrack (0);
+				return SOLVER_UNSAT;
+			}
+			solverNewLevel();
+			if (SOLVERVALUE(lit) == 0)
+				solverAssign (lit, -1);
+		}
+		else
+		{
+			v = 0;
+			while (solver.heapSize > 0 && v == 0)
+			{
+				v = solverHeapRemoveMax();
+				if (solver.value[v] != 0)
+					v = 0;
+			}
+			if (v == 0)
+			{
+				memcpy (solver.model, solver.value, (1+solver.numVars)*sizeof(int));
+				solverBacktrack (0);
+				return SOLVER_SAT;
+			}
+			solverNewLevel();
+			solverAssign (solver.phase[v] > 0 ? v : -v, -1);
+		}
+	}
+}
+
+/* Failed literal probing followed by backbone extraction with the solver,
+   within backboneTime seconds. A literal whose propagation fails is false in
+   every model, and a literal is in the backbone if the formula is
+   unsatisfiable with it false; literals which differ between two models are
+   not. Each literal found true at level 0 is added as a unit clause, so that
+   propagateUnitClauses removes its variable and the count is unchanged. */
+void probeBackbone()
 {
-	int c,v;
+	int *isUnit, *candidate;
+	int v,w,c,i,lit,result,numUnits,failed = 0,backbone = 0;
 	ClausePtr clause;
 	
+	if (backboneTime <= 0 || numClauses == 0)
+		return;
+	initSolver();
+	solver.deadline = getCPUTimeSinceStart() + backboneTime;
+	if (!solver.unsat && solverPropagate() >= 0)
+		solver.unsat = true;
+	
+	for (v=1; v<=numVars && !solver.unsat && ((v & 255) != 0 || getCPUTimeSinceStart() < solver.deadline); v++)
+	{
+		for (i=0; i<2 && solver.value[v] == 0; i++)
+		{
+			lit = i ? -v : v;
+			solverNewLevel();
+			solverAssign (lit, -1);
+			result = solverPropagate();
+			solverBacktrack (0);
+			if (result >= 0)
+			{
+				failed++;
+				solverAssign (-lit, -1);
+				if (solverPropagate() >= 0)
+					solver.unsat = true;
+			}
+		}
+	}
+	
+	if (!solver.unsat && solve (NULL, 0, LONG_MAX) == SOLVER_SAT)
+	{
+		candidate = checkMalloc ((1+numVars)*sizeof(int), "candidate");
+		for (v=1; v<=numVars; v++)
+			candidate[v] = 0;
+		for (c=0; c<numClauses; c++)
+			for (i=0; i<clauses[c]->length; i++)
+			{
+				v = abs(clauses[c]->lits[i]);
+				if (solver.value[v] == 0)
+					candidate[v] = solver.model[v];
+			}
+		for (v=1; v<=numVars && !solver.unsat && getCPUTimeSinceStart() < solver.deadline; v++)
+		{
+			if (candidate[v] == 0 || solver.value[v] != 0)
+				continue;
+			lit = (candidate[v] > 0) ? -v : v;
+			result = solve (&lit, 1, BACKBONE_CONFLICTS);
+			if (result == SOLVER_UNSAT && !solver.unsat)
+			{
+				backbone++;
+				if (solver.value[v] == 0)
+				{
+					solverAssign (-lit, -1);
+					if (solverPropagate() >= 0)
+						solver.unsat = true;
+				}
+			}
+			else if (result == SOLVER_SAT)
+			{
+				for (w=v+1; w<=numVars; w++)
+					if (candidate[w] != solver.model[w])
+						candidate[w] = 0;
+			}
+		}
+		checkFree (candidate);
+	}
+	
+	fprintf (outFile, "c o FAILED-LITERALS=%d\n", failed); fflush (outFile);
+	fprintf (outFile, "c o BACKBONE-LITERALS=%d\n", backbone); fflush (outFile);
+	if (solver.unsat)
+	{
+		unsatReason = "backbone probing";
+		printFinal (STATUS_UNSAT_FOUND);
+	}
+	
+	isUnit = checkMalloc ((1+numVars)*sizeof(int), "isunit");
+	for (v=1; v<=numVars; v++)
+		isUnit[v] = false;
 	for (c=0; c<numClauses; c++)
+		if (clauses[c]->length == 1)
+			isUnit[abs(clauses[c]->lits[0])] = true;
+	numUnits = 0;
+	for (i=0; i<solver.trailSize; i++)
+		if (!isUnit[abs(solver.trail[i])])
+			numUnits++;
+	if (numUnits > 0)
 	{
-		clause = clauses[c];
-		for (v=0; v<clause->length; v++)
+		clauses = checkRealloc (clauses, (numClauses+numUnits)*sizeof(ClausePtr), "clauses");
+		for (i=0; i<solver.trailSize; i++)
 		{
-			if (clause->lits[v] > 0)
-				clause->lits[v] = mapVariables[clause->lits[v]];
-			else
-				clause->lits[v] = -mapVariables[-clause->lits[v]];
+			if (isUnit[abs(solver.trail[i])])
+				continue;
+			clause = newClause();
+			clause->length = 1;
+			clause->lits = checkMalloc (sizeof(int), "unitlits");
+			clause->lits[0] = solver.trail[i];
+			clauses[numClauses++] = clause;
 		}
 	}
+	checkFree (isUnit);
+	freeSolver();
 }
 
+#define LITVALUE(l)	(((l)>0)?value[l]:-value[-(l)])
 
+/* Unit propagation with two watched literals per clause. Literals are only
+   ever made false, so each clause keeps a cursor beyond which no literal has
+   been looked at and the search for a new watch never goes back. Satisfied
+   clauses and false literals are removed in one pass at the end. */
 void propagateUnitClauses()
 {
 	int *unitLits, numUnitLits;
-	int *isUnitLit;
+	int *value, *watch0, *watch1, *cursor;
 	int *isUsed;
-	int v,c,lit,var,clit,v1,var1,lit1,varFound;
+	int v,c,o,lit,falseLit,other,v1,found,satisfied,conflict = false;
 	int readPos, writePos;
 	int newNumClauses, newNumVars;
 	ClausePtr clause;
 	
 	unitLits = checkMalloc ((numVars+1)*sizeof(int),"unitlits");
-	isUnitLit = checkMalloc ((numVars+1)*sizeof(int),"isunitlit");
+	value = checkMalloc ((numVars+1)*sizeof(int),"value");
+	watch0 = checkMalloc ((numClauses+1)*sizeof(int),"watch0");
+	watch1 = checkMalloc ((numClauses+1)*sizeof(int),"watch1");
+	cursor = checkMalloc ((numClauses+1)*sizeof(int),"cursor");
 	readPos = 0;
 	writePos = 0;
 	newNumVars = numVars;
-	numUnitLits = 0;
 	
 	for (v=1;v<=numVars;v++)
-		isUnitLit[v] = false;
+		value[v] = 0;
 	for (c=0; c<numClauses;c++)
 	{
 		clause = clauses[c];
+		watch0[c] = 0;
+		watch1[c] = 1;
+		cursor[c] = 2;
 		if (clause->length == 1)
 		{
 			lit = clause->lits[0];
-			var = abs(lit);
-			if (!isUnitLit[var])
+			if (LITVALUE(lit) < 0)
+				conflict = true;
+			else if (LITVALUE(lit) == 0)
 			{
-				isUnitLit[var] = true;
+				value[abs(lit)] = (lit > 0) ? 1 : -1;
 				unitLits[writePos++] = lit;
-				numUnitLits++;
 			}
 		}
 	}
 	
 	fprintf (outFile, "c o UNIT-CLAUSES=%d\n", writePos); fflush(stdout);
-	setUpVarToClause();
+	if (conflict)
+		printFinal (STATUS_UNSAT_FOUND);
+	buildOccurrences();
 	while (readPos < writePos)
 	{
-		lit = unitLits[readPos++];
-		var = abs(lit);
-		startScanBlockList (varToClause[var]);
-		while (hasNextBlockList(varToClause[var]))
+		falseLit = -unitLits[readPos++];
+		for (o=occStart[LIT2CODE(falseLit)]; o<occStart[LIT2CODE(falseLit)+1]; o++)
 		{
-			clause = getNextBlockList(varToClause[var]);
-			varFound = false;
-			for (v=0; v<clause->length && !varFound;v++)
+			c = occClauses[o];
+			clause = clauses[c];
+			if (clause->length < 2)
+				continue;
+			if (clause->lits[watch0[c]] == falseLit)
+				other = clause->lits[watch1[c]];
+			else if (clause->lits[watch1[c]] == falseLit)
+				other = clause->lits[watch0[c]];
+			else
+				continue;
+			if (LITVALUE(other) > 0)
+				continue;
+			
+			found = false;
+			for (v=cursor[c]; v<clause->length && !found; v++)
 			{
-				clit = clause->lits[v];
-				if (abs(clit) == var)
+				if (LITVALUE(clause->lits[v]) >= 0)
 				{
-					varFound = true;
-					if (lit == clit)
-						clause->redundant = true;
+					if (clause->lits[watch0[c]] == falseLit)
+						watch0[c] = v;
 					else
-					{
-						for (v1=v; v1<clause->length-1; v1++)
-							clause->lits[v1] = clause->lits[v1+1];
-						clause->length--;
-						if (clause->length == 1)
-						{
-							lit1 = clause->lits[0];
-							var1 = abs(lit1);
-							if (!isUnitLit[var1])
-							{
-								isUnitLit[var1] = true;
-								unitLits[writePos++] = lit1;
-								numUnitLits++;
-							}
-						}
-						else if (clause->length == 0)
-							printFinal (STATUS_UNSAT_FOUND);
-					}
+						watch1[c] = v;
+					found = true;
 				}
 			}
+			cursor[c] = v;
+			
+			if (!found)
+			{
+				if (LITVALUE(other) < 0)
+					printFinal (STATUS_UNSAT_FOUND);
+				value[abs(other)] = (other > 0) ? 1 : -1;
+				unitLits[writePos++] = other;
+			}
+		}
+	}
+	numUnitLits = writePos;
+	freeOccurrences();
+	
+	for (c=0; c<numClauses; c++)
+	{
+		clause = clauses[c];
+		satisfied = false;
+		v1 = 0;
+		for (v=0; v<clause->length && !satisfied; v++)
+		{
+			lit = clause->lits[v];
+			if (LITVALUE(lit) > 0)
+				satisfied = true;
+			else if (LITVALUE(lit) == 0)
+				clause->lits[v1++] = lit;
 		}
+		if (satisfied)
+			clause->redundant = true;
+		else
+			clause->length = v1;
 	}
 	
-	freeVarToClause ();
+	checkFree (watch0);
+	checkFree (watch1);
+	checkFree (cursor);
 	
 	isUsed = checkMalloc ((1+numVars)*sizeof(int),"isused");
+
 	for (v=1;v<=numVars;v++)
 	{
 		isUsed[v] = false;
@@ -1307,6 +3532,8 @@ void propagateUnitClauses()
 			{
 				mapVariables[v] = ++v1;
 			}
+			else
+				mapVariables[v] = 0;
 		}
 		numVars = v1;
 		
@@ -1314,8 +3541,509 @@ void propagateUnitClauses()
 	}
 	
 	checkFree (isUsed);
-	checkFree (isUnitLit);
+	checkFree (value);
 	checkFree (unitLits);
+	
+	compactClauses();
+	
+	optimised = (int *) checkMalloc ( (1+numVars)*sizeof(int), "optimised");
+	for (v=1;v<=numVars;v++)
+		optimised[v] = 0;
+}
+
+/* A variable whose clauses have all been removed by the optimisations after
+   unit propagation is now free; it is marked as optimised so that
+   sortSubProblems leaves it out and is counted with the unused variables. */
+void markUnusedVariables()
+{
+	int c,p,v,newlyUnused,*isUsed;
+	
+	isUsed = checkMalloc ((1+numVars)*sizeof(int), "isused");
+	for (v=1; v<=numVars; v++)
+		isUsed[v] = false;
+	for (c=0; c<numClauses; c++)
+		for (p=0; p<clauses[c]->length; p++)
+			isUsed[abs(clauses[c]->lits[p])] = true;
+	newlyUnused = 0;
+	for (v=1; v<=numVars; v++)
+		if (!isUsed[v] && !optimised[v])
+		{
+			optimised[v] = 1;
+			newlyUnused++;
+		}
+	checkFree (isUsed);
+	if (newlyUnused > 0)
+	{
+		unusedVariables += newlyUnused;
+		fprintf (outFile, "c o UNUSED-VARIABLES=%d\n", unusedVariables); fflush (outFile);
+	}
+}
+
+#define SUBSUMPTION_STEPS	200000000
+#define SUBSUME_NONE	INT_MAX
+
+uint64_t clauseSignature (ClausePtr clause)
+{
+	uint64_t signature = 0;
+	int p;
+	
+	for (p=0; p<clause->length; p++)
+		signature |= 1ULL << (abs(clause->lits[p]) & 63);
+	return signature;
+}
+
+/* Both clauses have their literals in variable order. Returns 0 if clause1
+   subsumes clause2, the literal of clause1 whose negation can be removed
+   from clause2 if they differ only in its sign, and otherwise SUBSUME_NONE. */
+int subsumes (ClausePtr clause1, ClausePtr clause2, int *steps)
+{
+	int p1 = 0, p2 = 0, flipped = 0;
+	
+	while (p1 < clause1->length)
+	{
+		if (p2 == clause2->length)
+			return SUBSUME_NONE;
+		(*steps)++;
+		if (abs(clause2->lits[p2]) < abs(clause1->lits[p1]))
+			p2++;
+		else if (abs(clause2->lits[p2]) > abs(clause1->lits[p1]))
+			return SUBSUME_NONE;
+		else
+		{
+			if (clause1->lits[p1] != clause2->lits[p2])
+			{
+				if (flipped != 0)
+					return SUBSUME_NONE;
+				flipped = clause1->lits[p1];
+			}
+			p1++;
+			p2++;
+		}
+	}
+	return flipped;
+}
+
+int clauseLengthCompare (const void *a, const void *b)
+{
+	return clauses[*(int *)a]->length - clauses[*(int *)b]->length;
+}
+
+/* Backward subsumption and self-subsuming resolution. Each clause in turn is
+   compared with the clauses containing the variable of it with the fewest
+   occurrences, filtered by signatures. A clause containing another is
+   removed, and if (l A) and (-l B) with A a subset of B then -l is removed
+   from the second, which is queued again since it may now subsume others.
+   Neither changes the set of models. The occurrence lists are not updated
+   when a literal is removed since the comparison checks the literals. */
+void subsumeClauses()
+{
+	uint64_t *signature;
+	int *queue, *inQueue;
+	int c,d,p,q,i,o,code,best,bestCount,count,result,head,tail;
+	int oldNumClauses, steps = 0, subsumed = 0, strengthened = 0;
+	ClausePtr clause, other;
+	
+	if (numClauses == 0)
+		return;
+	buildOccurrences();
+	signature = checkMalloc (numClauses*sizeof(uint64_t), "signature");
+	queue = checkMalloc ((numClauses+1)*sizeof(int), "subsumequeue");
+	inQueue = checkMalloc (numClauses*sizeof(int), "inqueue");
+	for (c=0; c<numClauses; c++)
+	{
+		signature[c] = clauseSignature (clauses[c]);
+		queue[c] = c;
+		inQueue[c] = true;
+	}
+	qsort (queue, numClauses, sizeof(int), clauseLengthCompare);
+	head = 0;
+	tail = numClauses;
+	
+	while (head != tail && steps < SUBSUMPTION_STEPS)
+	{
+		c = queue[head];
+		head = (head+1) % (numClauses+1);
+		inQueue[c] = false;
+		clause = clauses[c];
+		if (clause->redundant)
+			continue;
+		
+		best = clause->lits[0];
+		bestCount = INT_MAX;
+		for (p=0; p<clause->length; p++)
+		{
+			code = LIT2CODE(abs(clause->lits[p]));
+			count = occStart[code+1] - occStart[code-1];
+			if (count < bestCount)
+			{
+				bestCount = count;
+				best = abs(clause->lits[p]);
+			}
+		}
+		
+		for (i=0; i<2; i++)
+		{
+			code = LIT2CODE(i ? best : -best);
+			for (o=occStart[code]; o<occStart[code+1] && !clause->redundant; o++)
+			{
+				d = occClauses[o];
+				other = clauses[d];
+				if (d == c || other->redundant || other->length < clause->length ||
+					(signature[c] & ~signature[d]) != 0)
+					continue;
+				result = subsumes (clause, other, &steps);
+				if (result == 0)
+				{
+					other->redundant = true;
+					subsumed++;
+				}
+				else if (result != SUBSUME_NONE)
+				{
+					for (p=0, q=0; p<other->length; p++)
+						if (other->lits[p] != -result)
+							other->lits[q++] = other->lits[p];
+					other->length = q;
+					if (q == 0)
+					{
+						unsatReason = "subsumption";
+						printFinal (STATUS_UNSAT_FOUND);
+					}
+					signature[d] = clauseSignature (other);
+					strengthened++;
+					if (!inQueue[d])
+					{
+						queue[tail] = d;
+						tail = (tail+1) % (numClauses+1);
+						inQueue[d] = true;
+					}
+				}
+			}
+		}
+	}
+	
+	freeOccurrences();
+	checkFree (signature);
+	checkFree (queue);
+	checkFree (inQueue);
+	
+	fprintf (outFile, "c o SUBSUMED=%d\n", subsumed); fflush (outFile);
+	fprintf (outFile, "c o STRENGTHENED=%d\n", strengthened); fflush (outFile);
+	
+	oldNumClauses = numClauses;
+	numClauses = 0;
+	for (c=0;c<oldNumClauses;c++)
+	{
+		if (clauses[c]->redundant)
+			freeClause (clauses[c]);
+		else
+			clauses[numClauses++] = clauses[c];
+	}
+	if (strengthened > 0)
+		removeDuplicateClauses();
+	markUnusedVariables();
+}
+
+#define XOR_MAX_LENGTH	6
+#define XOR_MATRIX_BYTES	(1<<26)
+#define XOR_GAUSS_WORK	1000000000.0
+
+int clauseVarsCompare (const void *a, const void *b)
+{
+	ClausePtr clause1 = clauses[*(int *)a], clause2 = clauses[*(int *)b];
+	int p;
+	
+	if (clause1->length != clause2->length)
+		return clause1->length - clause2->length;
+	for (p=0; p<clause1->length; p++)
+		if (abs(clause1->lits[p]) != abs(clause2->lits[p]))
+			return abs(clause1->lits[p]) - abs(clause2->lits[p]);
+	return 0;
+}
+
+/* Recovers XOR constraints from complete groups of clauses: the 2^(k-1)
+   clauses over the same k variables with an even (or odd) number of negative
+   literals forbid exactly the assignments of even (or odd) parity. The
+   constraints are reduced by Gauss-Jordan elimination over GF(2), choosing
+   as pivots variables which appear in no other clauses where possible. A row
+   whose pivot appears nowhere else fixes that variable from the others, so
+   the row is dropped and the variable marked as optimised without changing
+   the count; the remaining rows replace the original groups if that does not
+   take more clauses. */
+void recoverXors()
+{
+	int *order, *isXorClause, *column, *columnVar, *xorOnly, *pivotColumn, *rhs;
+	uint64_t *matrix, *row, *other, *onlyMask, *keys, *hashes, seen, full, word;
+	int *counts;
+	int c,i,j,k,v,p,pattern,parity,numCandidates,start,numXors,numXorClauses,numColumns,words,size;
+	int rank,eliminated,numNew,rewrite,length,oldNumClauses,lits[XOR_MAX_LENGTH];
+	ClausePtr clause;
+	
+	/* only clauses whose set of variables is shared by enough others to
+	   complete a group are sorted, counted by a hash of the set */
+	for (size=1; size < 2*numClauses; size *= 2);
+	keys = checkMalloc (size*sizeof(uint64_t), "xorkeys");
+	counts = checkMalloc (size*sizeof(int), "xorcounts");
+	hashes = checkMalloc ((numClauses+1)*sizeof(uint64_t), "xorhashes");
+	memset (counts, 0, size*sizeof(int));
+	for (c=0; c<numClauses; c++)
+	{
+		clause = clauses[c];
+		hashes[c] = 0;
+		if (clause->length < 2 || clause->length > XOR_MAX_LENGTH)
+			continue;
+		for (p=0; p<clause->length; p++)
+			hashes[c] = (hashes[c] ^ abs(clause->lits[p])) * 0x9e3779b97f4a7c15ULL;
+		for (j=(hashes[c] >> 32) & (size-1); counts[j] > 0 && keys[j] != hashes[c]; j=(j+1) & (size-1));
+		keys[j] = hashes[c];
+		counts[j]++;
+	}
+	order = checkMalloc ((numClauses+1)*sizeof(int), "xororder");
+	numCandidates = 0;
+	for (c=0; c<numClauses; c++)
+	{
+		if (hashes[c] == 0)
+			continue;
+		for (j=(hashes[c] >> 32) & (size-1); keys[j] != hashes[c]; j=(j+1) & (size-1));
+		if (counts[j] >= 1 << (clauses[c]->length-1))
+			order[numCandidates++] = c;
+	}
+	checkFree (keys);
+	checkFree (counts);
+	checkFree (hashes);
+	qsort (order, numCandidates, sizeof(int), clauseVarsCompare);
+	
+	/* first pass finds the groups, second fills the matrix */
+	isXorClause = checkMalloc ((numClauses+1)*sizeof(int), "isxorclause");
+	for (c=0; c<numClauses; c++)
+		isXorClause[c] = false;
+	numXors = 0;
+	for (start=0; start<numCandidates; start=i)
+	{
+		k = clauses[order[start]]->length;
+		seen = 0;
+		for (i=start; i<numCandidates && clauseVarsCompare (&order[start], &order[i]) == 0; i++)
+		{
+			clause = clauses[order[i]];
+			for (pattern=0, p=0; p<k; p++)
+				if (clause->lits[p] < 0)
+					pattern |= 1 << p;
+			seen |= 1ULL << pattern;
+		}
+		for (parity=0; parity<2; parity++)
+		{
+			full = 0;
+			for (pattern=0; pattern<(1<<k); pattern++)
+				if ((__builtin_popcount(pattern) & 1) == parity)
+					full |= 1ULL << pattern;
+			if ((seen & full) != full)
+				continue;
+			numXors++;
+			for (j=start; j<i; j++)
+			{
+				clause = clauses[order[j]];
+				for (pattern=0, p=0; p<k; p++)
+					if (clause->lits[p] < 0)
+						pattern |= 1 << p;
+				if ((__builtin_popcount(pattern) & 1) == parity)
+					isXorClause[order[j]] = true;
+			}
+		}
+	}
+	
+	fprintf (outFile, "c o XOR-CONSTRAINTS=%d\n", numXors); fflush (outFile);
+	if (numXors == 0)
+	{
+		checkFree (order);
+		checkFree (isXorClause);
+		return;
+	}
+	
+	/* columns are the variables of the constraints in increasing order */
+	column = checkMalloc ((1+numVars)*sizeof(int), "xorcolumn");
+	xorOnly = checkMalloc ((1+numVars)*sizeof(int), "xoronly");
+	for (v=1; v<=numVars; v++)
+	{
+		column[v] = -1;
+		xorOnly[v] = true;
+	}
+	numXorClauses = 0;
+	for (c=0; c<numClauses; c++)
+	{
+		clause = clauses[c];
+		if (isXorClause[c])
+			numXorClauses++;
+		for (p=0; p<clause->length; p++)
+		{
+			if (isXorClause[c])
+				column[abs(clause->lits[p])] = 0;
+			else
+				xorOnly[abs(clause->lits[p])] = false;
+		}
+	}
+	numColumns = 0;
+	for (v=1; v<=numVars; v++)
+		if (column[v] == 0)
+			column[v] = numColumns++;
+	words = (numColumns+63)/64;
+	if ((double) numXors*words*sizeof(uint64_t) > XOR_MATRIX_BYTES ||
+		(double) numXors*numXors*words > XOR_GAUSS_WORK)
+	{
+		checkFree (order);
+		checkFree (isXorClause);
+		checkFree (column);
+		checkFree (xorOnly);
+		return;
+	}
+	columnVar = checkMalloc ((numColumns+1)*sizeof(int), "xorcolumnvar");
+	onlyMask = checkMalloc ((words+1)*sizeof(uint64_t), "xoronlymask");
+	memset (onlyMask, 0, (words+1)*sizeof(uint64_t));
+	for (v=1; v<=numVars; v++)
+		if (column[v] >= 0)
+		{
+			columnVar[column[v]] = v;
+			if (xorOnly[v])
+				onlyMask[column[v]/64] |= 1ULL << (column[v]%64);
+		}
+	
+	matrix = checkMalloc ((numXors*words+1)*sizeof(uint64_t), "xormatrix");
+	memset (matrix, 0, (numXors*words+1)*sizeof(uint64_t));
+	rhs = checkMalloc (numXors*sizeof(int), "xorrhs");
+	numXors = 0;
+	for (start=0; start<numCandidates; start=i)
+	{
+		for (i=start+1; i<numCandidates && clauseVarsCompare (&order[start], &order[i]) == 0; i++);
+		for (parity=0; parity<2; parity++)
+		{
+			for (j=start; j<i; j++)
+			{
+				clause = clauses[order[j]];
+				for (pattern=0, p=0; p<clause->length; p++)
+					if (clause->lits[p] < 0)
+						pattern++;
+				if (isXorClause[order[j]] && (pattern & 1) == parity)
+					break;
+			}
+			if (j == i)
+				continue;
+			row = matrix + numXors*words;
+			for (p=0; p<clause->length; p++)
+				row[column[abs(clause->lits[p])]/64] |= 1ULL << (column[abs(clause->lits[p])]%64);
+			rhs[numXors++] = 1-parity;
+		}
+	}
+	checkFree (order);
+	
+	/* Gauss-Jordan elimination, leaving each pivot in one row only */
+	pivotColumn = checkMalloc (numXors*sizeof(int), "xorpivot");
+	rank = 0;
+	for (i=0; i<numXors; i++)
+	{
+		row = matrix + i*words;
+		pivotColumn[i] = -1;
+		for (j=0; j<words && pivotColumn[i] < 0; j++)
+			if ((word = row[j] & onlyMask[j]) != 0)
+				pivotColumn[i] = 64*j + __builtin_ctzll(word);
+		for (j=0; j<words && pivotColumn[i] < 0; j++)
+			if (row[j] != 0)
+				pivotColumn[i] = 64*j + __builtin_ctzll(row[j]);
+		if (pivotColumn[i] < 0)
+		{
+			if (rhs[i])
+			{
+				fprintf (outFile, "c o XOR-RANK=%d\n", rank);
+				unsatReason = "XOR elimination";
+				printFinal (STATUS_UNSAT_FOUND);
+			}
+			continue;
+		}
+		rank++;
+		for (j=0; j<numXors; j++)
+		{
+			other = matrix + j*words;
+			if (j == i || !(other[pivotColumn[i]/64] & (1ULL << (pivotColumn[i]%64))))
+				continue;
+			for (k=0; k<words; k++)
+				other[k] ^= row[k];
+			rhs[j] ^= rhs[i];
+		}
+	}
+	
+	/* a row is kept if its pivot appears in other clauses */
+	rewrite = true;
+	numNew = 0;
+	eliminated = 0;
+	for (i=0; i<numXors; i++)
+	{
+		if (pivotColumn[i] < 0)
+			continue;
+		if (xorOnly[columnVar[pivotColumn[i]]])
+		{
+			eliminated++;
+			continue;
+		}
+		row = matrix + i*words;
+		for (length=0, j=0; j<words; j++)
+			length += __builtin_popcountll(row[j]);
+		if (length > XOR_MAX_LENGTH)
+			rewrite = false;
+		else
+			numNew += 1 << (length-1);
+	}
+	if (numNew > numXorClauses)
+		rewrite = false;
+	
+	fprintf (outFile, "c o XOR-RANK=%d\n", rank); fflush (outFile);
+	fprintf (outFile, "c o XOR-ELIMINATED-VARIABLES=%d\n", rewrite ? eliminated : 0); fflush (outFile);
+	
+	if (rewrite)
+	{
+		oldNumClauses = numClauses;
+		numClauses = 0;
+		for (c=0; c<oldNumClauses; c++)
+		{
+			if (isXorClause[c])
+				freeClause (clauses[c]);
+			else
+				clauses[numClauses++] = clauses[c];
+		}
+		for (i=0; i<numXors; i++)
+		{
+			if (pivotColumn[i] < 0)
+				continue;
+			if (xorOnly[columnVar[pivotColumn[i]]])
+			{
+				optimised[columnVar[pivotColumn[i]]] = 1;
+				continue;
+			}
+			row = matrix + i*words;
+			for (length=0, j=0; j<numColumns; j++)
+				if (row[j/64] & (1ULL << (j%64)))
+					lits[length++] = columnVar[j];
+			/* the clauses forbid the assignments of the wrong parity */
+			for (pattern=0; pattern<(1<<length); pattern++)
+			{
+				if ((__builtin_popcount(pattern) & 1) == rhs[i])
+					continue;
+				clause = newClause();
+				clause->length = length;
+				clause->lits = checkMalloc (length*sizeof(int), "xorlits");
+				for (p=0; p<length; p++)
+					clause->lits[p] = (pattern & (1 << p)) ? -lits[p] : lits[p];
+				clauses[numClauses++] = clause;
+			}
+		}
+		removeDuplicateClauses();
+		markUnusedVariables();
+	}
+	
+	checkFree (isXorClause);
+	checkFree (column);
+	checkFree (columnVar);
+	checkFree (xorOnly);
+	checkFree (onlyMask);
+	checkFree (matrix);
+	checkFree (rhs);
+	checkFree (pivotColumn);
 }
 
 typedef struct VariableStruct
@@ -1916,14 +4644,129 @@ void sortVars1 (int startv, int finishv, int startc, int finishc)
 	
 }
 
+/* The clause pass of sortVars4 finds the first and last variable of each
+   clause in the current order and the amount by which it pulls them
+   together. On large regions this is shared out between the threads; the
+   weights are then changed in clause order as before, so the order found
+   does not depend on the number of threads. */
+
+#define MIN_PARALLEL_SPAN_CLAUSES (1<<16)
+#define SORT_BLOCK_CLAUSES 4096
+
+typedef struct SpanJobStruct
+{
+	int startc, finishc, nextBlock, numBlocks;
+	int *minVars, *maxVars;
+	double increment, *amounts;
+} SpanJob;
+
+void *findClauseSpans (void *arg)
+{
+	SpanJob *job = (SpanJob *) arg;
+	ClausePtr clause;
+	int b,c,p,var,minVar,maxVar,limit;
+	
+	while ((b = __sync_fetch_and_add (&job->nextBlock, 1)) < job->numBlocks)
+	{
+		limit = job->startc + (b+1)*SORT_BLOCK_CLAUSES;
+		if (limit > job->finishc+1)
+			limit = job->finishc+1;
+		for (c=job->startc + b*SORT_BLOCK_CLAUSES; c<limit; c++)
+		{
+			clause = clauses[c];
+			minVar = numVars;
+			maxVar = 1;
+			for (p=0; p<clause->length; p++)
+			{
+				var = mapVariables[abs(clause->lits[p])];
+				if (var < minVar) minVar = var;
+				if (var > maxVar) maxVar = var;
+			}
+			job->minVars[c-job->startc] = minVar;
+			job->maxVars[c-job->startc] = maxVar;
+			job->amounts[c-job->startc] = job->increment*sqrt( 10 + (double) (maxVar+1-minVar));
+		}
+	}
+	return NULL;
+}
+
+/* After the clause pass the variables are put back in order of weight by a
+   merge sort which starts from the runs already in order, and turns round
+   the runs in reverse order, so that little work is done once the order
+   has nearly settled. temp and runs must have room for the region. */
+void reorderVariables (Variable *variables, Variable *temp, int *runs, int startv, int finishv)
+{
+	Variable swap, *from, *to, *t;
+	int i,j,k,r,v,end,numRuns;
+	
+	numRuns = 0;
+	for (v=startv; v<=finishv; v=end)
+	{
+		runs[numRuns++] = v;
+		end = v+1;
+		if (end <= finishv && variables[end].weight < variables[v].weight)
+		{
+			while (end < finishv && variables[end+1].weight < variables[end].weight)
+				end++;
+			for (i=v, j=end; i<j; i++, j--)
+			{
+				swap = variables[i];
+				variables[i] = variables[j];
+				variables[j] = swap;
+			}
+			end++;
+		}
+		else
+			while (end <= finishv && variables[end].weight >= variables[end-1].weight)
+				end++;
+	}
+	runs[numRuns] = finishv+1;
+	
+	from = variables;
+	to = temp;
+	while (numRuns > 1)
+	{
+		for (k=0, r=0; r<numRuns; r+=2)
+		{
+			if (r+1 == numRuns)
+				memcpy (to+runs[r], from+runs[r], (runs[r+1]-runs[r])*sizeof(Variable));
+			else
+			{
+				i = runs[r];
+				j = runs[r+1];
+				end = runs[r+2];
+				v = i;
+				while (i < runs[r+1] && j < end)
+					to[v++] = (from[j].weight < from[i].weight) ? from[j++] : from[i++];
+				while (i < runs[r+1])
+					to[v++] = from[i++];
+				while (j < end)
+					to[v++] = from[j++];
+			}
+			runs[k++] = runs[r];
+		}
+		runs[k] = finishv+1;
+		numRuns = k;
+		t = from;
+		from = to;
+		to = t;
+	}
+	if (from != variables)
+		memcpy (variables+startv, from+startv, (finishv+1-startv)*sizeof(Variable));
+}
+
 void sortVars4 (int startv, int finishv, int startc, int finishc)
 {
-	int turn, v, c, lit, var,i,j,p,v1,v2;
+	int turn, v, c, var,i,j,p,v1,v2;
 	long localNumVars = finishv+1-startv, localNumClauses = finishc+1-startc;
-	int minVar, maxVar,steps,steps1, clauseLength;
+	int steps;
 	Variable *variables;
-	ClausePtr clause,clause1;
+	ClausePtr clause1;
 	time_t localSortStart,localSortFinish;
+	SpanJob job;
+	pthread_t *threads;
+	Variable *sorted;
+	int *started, *runs, t, numThreadsUsed;
 	
 	double weight, increment, ratio,r,delta,cog;
 	int converged=0;
@@ -1999,9 +4842,20 @@ void sortVars4 (int startv, int finishv, int startc, int finishc)
 	fprintf (outFile, "c o RATIO=%.6f\n", ratio);
 	
 		
+	job.startc = startc;
+	job.finishc = finishc;
+	job.numBlocks = (localNumClauses + SORT_BLOCK_CLAUSES - 1)/SORT_BLOCK_CLAUSES;
+	job.minVars = checkMalloc ((1+localNumClauses)*sizeof(int), "spanmin");
+	job.maxVars = checkMalloc ((1+localNumClauses)*sizeof(int), "spanmax");
+	job.amounts = checkMalloc ((1+localNumClauses)*sizeof(double), "spanamounts");
+	sorted = checkMalloc ((1+numVars)*sizeof(Variable), "sorted");
+	runs = checkMalloc ((2+localNumVars)*sizeof(int), "runs");
+	numThreadsUsed = (localNumClauses < MIN_PARALLEL_SPAN_CLAUSES) ? 1 : numThreads;
+	threads = checkMalloc (numThreadsUsed*sizeof(pthread_t), "spanthreads");
+	started = checkMalloc (numThreadsUsed*sizeof(int), "spanstarted");
+	
 	//fprintf (outFile, "c inc = %.2f ratio = %.8f\n", increment, ratio);
 	steps = 0;
-	steps1 = 0;
 	do
 	{
 		//increment = ((numVars+numClauses)*100)/(100 + turns++);
@@ -2013,33 +4867,27 @@ void sortVars4 (int startv, int finishv, int startc, int finishc)
 
 		//fprintf (outFile,"inc = %.8f\n",increment);
 		
-		for (c=startc; c<=finishc; c++)
+		job.increment = increment;
+		job.nextBlock = 0;
+		for (t=1; t<numThreadsUsed; t++)
+			started[t] = pthread_create (&threads[t], NULL, findClauseSpans, &job) == 0;
+		findClauseSpans (&job);
+		for (t=1; t<numThreadsUsed; t++)
+			if (started[t])
+				pthread_join (threads[t], NULL);
+		
+		for (c=0; c<localNumClauses; c++)
 		{
 			if ( steps++ == 100000000)
 			{
 				checkElapsed();
 				steps = 0;
 			}
-			clause = clauses[c];
-
-			minVar = numVars;
-			maxVar = 1;
-
-
-			for (v=0; v<clause->length; v++)
-			{
-				lit = clause->lits[v];
-				var = mapVariables[abs(lit)];
-				if (var < minVar) minVar = var;
-				if (var > maxVar) maxVar = var;
-			}
-			clauseLength = maxVar+1-minVar;
-			variables[maxVar].weight -= increment*sqrt( 10 + (double) clauseLength);
-			variables[minVar].weight += increment*sqrt( 10 + (double) clauseLength);
+			variables[job.maxVars[c]].weight -= job.amounts[c];
+			variables[job.minVars[c]].weight += job.amounts[c];
 		}
 		
-	
-		qsort (&variables[startv], localNumVars, sizeof(Variable), variableCompare);
+		reorderVariables (variables, sorted, runs, startv, finishv);
 		
 
 		converged = 0;
@@ -2059,145 +4907,924 @@ void sortVars4 (int startv, int finishv, int startc, int finishc)
 		//printf ("c=%d\n", converged);
 		
 	} while (converged>0);
+	checkFree (job.minVars);
+	checkFree (job.maxVars);
+	checkFree (job.amounts);
+	checkFree (sorted);
+	checkFree (runs);
+	checkFree (threads);
+	checkFree (started);
 	time (&localSortFinish);
 	fprintf (outFile, "c o SORTTIME=%.1f\n", difftime (localSortFinish, localSortStart)); fflush (outFile);
 
 }
 
-void sortSubProblems()
+/* Predicts the cost of sweeping a region with the variables in the order
+   given by position, and the clauses in order of their first variable as
+   sortClauses leaves them. A variable is in the frontier from the first to
+   the last clause it is in; cutwidth is the most variables in the frontier
+   at once, span adds up the distance from the first to the last variable of
+   each clause as in clauseLength, and widthCost is log2 of the sum over the
+   clauses of 2 to the power of the frontier width. With samples > 0 the
+   sweep is also simulated on the literal sets alone, without contributions
+   or subsumption, keeping at most samples of the frontier entries and
+   scaling up by the fraction kept, which estimates the largest frontier
+   and the operations. Without subsampling the simulation gives an upper
+   bound on both. */
+
+typedef struct FrontierPredictionStruct
 {
-	int *isUsed, *varsUsed;
-	int c,r,readPos, writePos, v, lit, var, thisVar, countVars, regionsCount;
-	int startc, finishc;
-	ClausePtr clause;
-	int *startvs,*finishvs, finished;
+	int cutwidth;
+	long long span;
+	double widthCost, maxFrontier, operations;
+} FrontierPrediction;
+
+int *predictLits, *predictStart, *predictLength;
+
+int predictEntryCompare (const void *a, const void *b)
+{
+	int e1 = *(int *)a, e2 = *(int *)b, p;
 	
-	if (numVars == 0) return;
+	if (predictLength[e1] != predictLength[e2])
+		return predictLength[e1] - predictLength[e2];
+	for (p=0; p<predictLength[e1]; p++)
+		if (predictLits[predictStart[e1]+p] != predictLits[predictStart[e2]+p])
+			return predictLits[predictStart[e1]+p] - predictLits[predictStart[e2]+p];
+	return 0;
+}
+
+/* One step of the simulated sweep: each entry of the frontier is kept
+   without the variables seen for the last time, and joined with the clause
+   unless it holds the negation of one of its literals. Returns the number
+   of entries made, before duplicates are removed. */
+int predictStep (ClausePtr clause, int step, int startv, int *last, int *mark, int stamp,
+	int *lits, int *start, int *length, int count, int *nextLits, int *nextStart, int *nextLength)
+{
+	int e,p,q,l,made,size,clashes;
+	
+	for (p=0; p<clause->length; p++)
+	{
+		l = clause->lits[p];
+		mark[2*(abs(l)-startv) + (l < 0)] = 2*stamp;
+		mark[2*(abs(l)-startv) + (l > 0)] = 2*stamp+1;
+	}
+	made = 0;
+	size = 0;
+	for (e=0; e<count; e++)
+	{
+		nextStart[made] = size;
+		clashes = false;
+		for (p=0; p<length[e]; p++)
+		{
+			l = lits[start[e]+p];
+			if (mark[2*(abs(l)-startv) + (l < 0)] == 2*stamp+1)
+				clashes = true;
+			if (last[abs(l)-startv] > step)
+				nextLits[size++] = l;
+		}
+		nextLength[made] = size - nextStart[made];
+		made++;
+		if (clashes)
+			continue;
 		
+		nextStart[made] = size;
+		for (p=0; p<length[e]; p++)
+		{
+			l = lits[start[e]+p];
+			if (last[abs(l)-startv] > step && mark[2*(abs(l)-startv) + (l < 0)] != 2*stamp)
+				nextLits[size++] = l;
+		}
+		for (p=0; p<clause->length; p++)
+		{
+			l = clause->lits[p];
+			if (last[abs(l)-startv] > step)
+			{
+				for (q=size; q>nextStart[made] && nextLits[q-1] > l; q--)
+					nextLits[q] = nextLits[q-1];
+				nextLits[q] = l;
+				size++;
+			}
+		}
+		nextLength[made] = size - nextStart[made];
+		made++;
+	}
+	return made;
+}
+
+void predictFrontier (int *position, int startv, int finishv, int startc, int finishc, int samples, FrontierPrediction *prediction)
+{
+	int n = finishv+1-startv, numRegionClauses = finishc+1-startc;
+	int c,e,i,k,p,v,width,made,count,unique,minPos,maxPos,capacity;
+	int *first,*last,*delta,*order,*bucket,*minVars,*mark;
+	int *lits,*start,*length,*nextLits,*nextStart,*nextLength,*entries,swap;
+	ClausePtr clause;
+	double sum, frontier, fraction, pairs, run;
+	uint64_t random;
+	
+	prediction->cutwidth = 0;
+	prediction->span = 0;
+	prediction->widthCost = 0;
+	prediction->maxFrontier = 1;
+	prediction->operations = 0;
+	if (numRegionClauses <= 0)
+		return;
+	
+	first = checkMalloc (n*sizeof(int), "predictfirst");
+	last = checkMalloc (n*sizeof(int), "predictlast");
+	delta = checkMalloc ((numRegionClauses+1)*sizeof(int), "predictdelta");
+	order = checkMalloc (numRegionClauses*sizeof(int), "predictorder");
+	bucket = checkMalloc ((n+1)*sizeof(int), "predictbucket");
+	minVars = checkMalloc (numRegionClauses*sizeof(int), "predictminvars");
+	memset (bucket, 0, (n+1)*sizeof(int));
+	for (c=startc; c<=finishc; c++)
+	{
+		clause = clauses[c];
+		minPos = n;
+		maxPos = 0;
+		for (p=0; p<clause->length; p++)
+		{
+			v = position[abs(clause->lits[p])]-startv;
+			if (v < minPos) minPos = v;
+			if (v > maxPos) maxPos = v;
+		}
+		if (minPos < maxPos)
+			prediction->span += maxPos-minPos;
+		minVars[c-startc] = (minPos < n) ? minPos : 0;
+		bucket[minVars[c-startc]+1]++;
+	}
+	for (v=0; v<n; v++)
+		bucket[v+1] += bucket[v];
+	for (c=startc; c<=finishc; c++)
+		order[bucket[minVars[c-startc]]++] = c;
 	
-	isUsed = checkMalloc ((1+numVars)*sizeof(int),"isused");
-	varsUsed = checkMalloc ((1+numVars)*sizeof(int),"varsused");
+	for (v=0; v<n; v++)
+		first[v] = -1;
+	for (i=0; i<numRegionClauses; i++)
+	{
+		clause = clauses[order[i]];
+		for (p=0; p<clause->length; p++)
+		{
+			v = abs(clause->lits[p])-startv;
+			if (first[v] < 0)
+				first[v] = i;
+			last[v] = i;
+		}
+	}
+	memset (delta, 0, (numRegionClauses+1)*sizeof(int));
+	for (v=0; v<n; v++)
+		if (first[v] >= 0)
+		{
+			delta[first[v]]++;
+			delta[last[v]+1]--;
+		}
+	for (width=0, i=0; i<numRegionClauses; i++)
+	{
+		width += delta[i];
+		if (width > prediction->cutwidth)
+			prediction->cutwidth = width;
+	}
+	for (sum=0, width=0, i=0; i<numRegionClauses; i++)
+	{
+		width += delta[i];
+		sum += exp2 (width - prediction->cutwidth);
+	}
+	prediction->widthCost = prediction->cutwidth + log2 (sum);
 	
-	startvs = checkMalloc ((1+numVars)*sizeof(int),"isused");
-	finishvs = checkMalloc ((1+numVars)*sizeof(int),"isused");
+	if (samples > 0)
+	{
+		/* an entry holds at most the variables in the frontier */
+		capacity = 2*samples*(prediction->cutwidth+1);
+		lits = checkMalloc (capacity*sizeof(int), "predictlits");
+		nextLits = checkMalloc (capacity*sizeof(int), "predictlits");
+		start = checkMalloc (2*samples*sizeof(int), "predictstart");
+		length = checkMalloc (2*samples*sizeof(int), "predictlength");
+		nextStart = checkMalloc (2*samples*sizeof(int), "predictstart");
+		nextLength = checkMalloc (2*samples*sizeof(int), "predictlength");
+		entries = checkMalloc (2*samples*sizeof(int), "predictentries");
+		mark = checkMalloc (2*n*sizeof(int), "predictmark");
+		for (v=0; v<2*n; v++)
+			mark[v] = 0;
+		
+		count = 1;
+		start[0] = 0;
+		length[0] = 0;
+		frontier = 1;
+		width = 0;
+		random = 0x853c49e6748fea9bULL ^ numRegionClauses;
+		for (i=0; i<numRegionClauses; i++)
+		{
+			made = predictStep (clauses[order[i]], i, startv, last, mark, i+1,
+				lits, start, length, count, nextLits, nextStart, nextLength);
+			fraction = count / frontier;
+			prediction->operations += (made-count) / fraction;
+			
+			for (e=0; e<made; e++)
+				entries[e] = e;
+			predictLits = nextLits;
+			predictStart = nextStart;
+			predictLength = nextLength;
+			qsort (entries, made, sizeof(int), predictEntryCompare);
+			for (unique=0, run=0, pairs=0, e=0; e<made; e++)
+				if (unique == 0 || predictEntryCompare (&entries[unique-1], &entries[e]) != 0)
+				{
+					entries[unique++] = entries[e];
+					run = 1;
+				}
+				else
+					pairs += run++;
+			
+			/* With the whole frontier in the sample the entries left are
+			   the next frontier. Otherwise the pairs of entries which
+			   coincide in the sample estimate how many coincide in the
+			   whole, taking each to be made about as often, and the
+			   frontier cannot hold more than 3^width literal sets. */
+			width += delta[i];
+			if (fraction >= 1)
+				frontier = unique;
+			else
+				frontier = fmin ((double) made*made / (2*pairs + made*fraction), pow (3, width));
+			if (frontier < unique)
+				frontier = unique;
+			if (frontier > prediction->maxFrontier)
+				prediction->maxFrontier = frontier;
+			
+			if (unique > samples)
+			{
+				for (e=0; e<samples; e++)
+				{
+					random = mixHash (random, e);
+					k = e + random % (unique-e);
+					swap = entries[k];
+					entries[k] = entries[e];
+					entries[e] = swap;
+				}
+				unique = samples;
+			}
+			
+			for (p=0, e=0; e<unique; e++)
+			{
+				start[e] = p;
+				length[e] = nextLength[entries[e]];
+				memcpy (lits+p, nextLits+nextStart[entries[e]], length[e]*sizeof(int));
+				p += length[e];
+			}
+			count = unique;
+		}
+		
+		checkFree (lits);
+		checkFree (nextLits);
+		checkFree (start);
+		checkFree (length);
+		checkFree (nextStart);
+		checkFree (nextLength);
+		checkFree (entries);
+		checkFree (mark);
+	}
 	
+	checkFree (first);
+	checkFree (last);
+	checkFree (delta);
+	checkFree (order);
+	checkFree (bucket);
+	checkFree (minVars);
+}
 
+/* The figure used to compare orders: log2 of the predicted operations when
+   the sweep has been simulated, and otherwise widthCost, which estimates
+   the same from the frontier widths alone. */
+double predictionScore (FrontierPrediction *prediction, int samples)
+{
+	if (samples > 0)
+		return log2 (1 + prediction->operations);
+	return prediction->widthCost;
+}
 
-	for (v=1;v<=numVars; v++)
-		isUsed[v] = false;
+/* With --predict=1 the prediction for the final order is reported for the
+   regions together before the count, and with --predict=2 instead of it. */
+void reportPrediction()
+{
+	FrontierPrediction prediction, total;
+	int r,v,*position;
+	double cost;
 	
-	isUsed[1] = true;
-	varsUsed[0] = 1;
-	readPos = 0;
-	writePos = 1;
-	countVars = 0;
-	regionsCount = 0;
+	position = checkMalloc ((1+numVars)*sizeof(int), "predictposition");
+	for (v=0; v<=numVars; v++)
+		position[v] = v;
+	if (regionsCount > 0 && regionStartc == NULL)
+		findRegionClauses();
 	
-	setUpVarToClause();
-	finished = 0;
+	total.cutwidth = 0;
+	total.span = 0;
+	total.maxFrontier = 0;
+	total.operations = 0;
+	cost = 0;
+	for (r=0; r<((regionsCount > 0) ? regionsCount : 1); r++)
+	{
+		if (regionsCount > 0)
+			predictFrontier (position, startvs[r], finishvs[r], regionStartc[r], regionFinishc[r], predictSamples, &prediction);
+		else
+			predictFrontier (position, 1, numVars, 0, numClauses-1, predictSamples, &prediction);
+		if (prediction.cutwidth > total.cutwidth)
+			total.cutwidth = prediction.cutwidth;
+		total.span += prediction.span;
+		if (prediction.maxFrontier > total.maxFrontier)
+			total.maxFrontier = prediction.maxFrontier;
+		total.operations += prediction.operations;
+		if (r == 0)
+			cost = prediction.widthCost;
+		else
+			cost = fmax (cost, prediction.widthCost) + log2 (1 + exp2 (-fabs (cost - prediction.widthCost)));
+	}
+	checkFree (position);
 	
-	while (!finished)
+	fprintf (outFile, "c o PREDICTED-CUTWIDTH=%d\n", total.cutwidth);
+	fprintf (outFile, "c o PREDICTED-SPAN=%lld\n", total.span);
+	fprintf (outFile, "c o PREDICTED-WIDTH-COST=%.2f\n", cost);
+	if (predictSamples > 0)
 	{
+		fprintf (outFile, "c o PREDICTED-MAX-FRONTIER=%.0f\n", total.maxFrontier);
+		fprintf (outFile, "c o PREDICTED-OPERATIONS=%.0f\n", total.operations);
+	}
+	fflush (outFile);
+	if (predictReport > 1)
+		exit (0);
+}
+
+/* With --order-portfolio=N, each region of at least PORTFOLIO_MIN_CLAUSES
+   clauses is ordered by N candidates: sortVars4, sortVars1, sortVars3 and
+   sortVars in turn, each with its own seed. The ordering engines work on
+   the global maps, so each candidate runs in a child process, up to
+   numThreads at a time, and sends back its order and predictionScore; the
+   cheapest order is kept. Once one candidate has finished, the others are
+   stopped when they have taken longer than both it and --portfolio-time
+   seconds, so an engine which does not settle cannot hold up the rest. */
+
+#define PORTFOLIO_MIN_CLAUSES 100
+#define PORTFOLIO_ENGINES 4
+
+typedef struct OrderCandidateStruct
+{
+	pid_t pid;
+	FILE *result;
+	int finished, *map;
+	double cost;
+	time_t started, stopped;
+} OrderCandidate;
+
+char *portfolioEngineNames[PORTFOLIO_ENGINES] = {"sortVars4", "sortVars1", "sortVars3", "sortVars"};
+
+void startOrderCandidate (OrderCandidate *candidate, int k, int startv, int finishv, int startc, int finishc)
+{
+	FrontierPrediction prediction;
+	int v;
 	
-		startvs[regionsCount] = writePos;
-		while (writePos > readPos)
-		{
-			thisVar = varsUsed[readPos++];
-			countVars++;
-			mapVariables[thisVar] = countVars; 						//printf ("%d -> %d\n", thisVar,countVars);
+	fflush (NULL);
+	candidate->finished = false;
+	candidate->map = NULL;
+	candidate->result = tmpfile();
+	time (&candidate->started);
+	if (candidate->result == NULL || (candidate->pid = fork()) < 0)
+	{
+		if (candidate->result != NULL)
+			fclose (candidate->result);
+		candidate->result = NULL;
+		candidate->pid = 0;
+		return;
+	}
+	if (candidate->pid > 0)
+		return;
+	
+	outFile = fopen ("/dev/null", "w");
+	if (outFile == NULL)
+		outFile = stderr;
+	/* the threads are already taken by the other candidates */
+	numThreads = 1;
+	srand (k+1);
+	for (v=startv; v<=finishv; v++)
+		mapVariables[v] = v;
+	switch (k % PORTFOLIO_ENGINES)
+	{
+		case 0:
+			sortVars4 (startv, finishv, startc, finishc);
+			break;
+		case 1:
+			sortVars1 (startv, finishv, startc, finishc);
+			break;
+		case 2:
+			sortVars3 (startv, finishv, startc, finishc);
+			break;
+		default:
+			sortVars (startv, finishv, startc, finishc);
+			break;
+	}
+	predictFrontier (mapVariables, startv, finishv, startc, finishc, predictSamples, &prediction);
+	fprintf (candidate->result, "%a\n", predictionScore (&prediction, predictSamples));
+	fwrite (mapVariables+startv, sizeof(int), finishv+1-startv, candidate->result);
+	fclose (candidate->result);
+	exit (0);
+}
 
-			startScanBlockList (varToClause[thisVar]);
-			while (hasNextBlockList(varToClause[thisVar]))
+/* Reads the order sent back by a candidate which has exited. */
+void finishOrderCandidate (OrderCandidate *candidate, int status, int numRegionVars)
+{
+	candidate->pid = 0;
+	time (&candidate->stopped);
+	rewind (candidate->result);
+	candidate->map = checkMalloc (numRegionVars*sizeof(int), "candidatemap");
+	candidate->finished = numRegionVars >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+		fscanf (candidate->result, "%la", &candidate->cost) == 1 && fgetc (candidate->result) == '\n' &&
+		fread (candidate->map, sizeof(int), numRegionVars, candidate->result) == (size_t) numRegionVars;
+	fclose (candidate->result);
+	candidate->result = NULL;
+}
+
+void portfolioSortVars (int startv, int finishv, int startc, int finishc)
+{
+	OrderCandidate *candidates;
+	time_t now, sortStart;
+	int k,best,next,running,changed,status,firstFinished,numRegionVars = finishv+1-startv;
+	double limit;
+	
+	time (&sortStart);
+	candidates = checkMalloc (orderPortfolio*sizeof(OrderCandidate), "candidates");
+	for (k=0; k<orderPortfolio; k++)
+	{
+		candidates[k].pid = 0;
+		candidates[k].finished = false;
+		candidates[k].map = NULL;
+	}
+	next = 0;
+	running = 0;
+	firstFinished = -1;
+	while (next < orderPortfolio || running > 0)
+	{
+		while (next < orderPortfolio && running < numThreads)
+		{
+			startOrderCandidate (&candidates[next], next, startv, finishv, startc, finishc);
+			if (candidates[next++].pid > 0)
+				running++;
+		}
+		
+		changed = false;
+		time (&now);
+		for (k=0; k<next; k++)
+		{
+			if (candidates[k].pid <= 0)
+				continue;
+			if (waitpid (candidates[k].pid, &status, WNOHANG) == candidates[k].pid)
 			{
-				clause = (ClausePtr) getNextBlockList(varToClause[thisVar]);
-				for (v=0; v<clause->length;v++)
+				finishOrderCandidate (&candidates[k], status, numRegionVars);
+				if (candidates[k].finished && firstFinished < 0)
+					firstFinished = k;
+				running--;
+				changed = true;
+			}
+			else if (firstFinished >= 0)
+			{
+				limit = difftime (candidates[firstFinished].stopped, candidates[firstFinished].started);
+				if (limit < portfolioTime)
+					limit = portfolioTime;
+				if (difftime (now, candidates[k].started) > limit)
 				{
-					lit = clause->lits[v];
-					var = abs(lit);
-					if (!isUsed[var])
-					{
-						isUsed[var] = true;
-						varsUsed[writePos++] = var;
-					}
+					kill (candidates[k].pid, SIGKILL);
+					waitpid (candidates[k].pid, NULL, 0);
+					candidates[k].pid = 0;
+					fclose (candidates[k].result);
+					candidates[k].result = NULL;
+					running--;
+					changed = true;
 				}
 			}
 		}
-		finishvs[regionsCount] = writePos;
-		regionsCount++;
-		
-		if (!finished)
+		if (!changed && running > 0)
 		{
-			for (v=1; v <= numVars && (isUsed[v] || optimised[v]); v++);
-			if (v > numVars)
-				finished = true;
-			else
-			{
-				isUsed[v] = true;
-				varsUsed[writePos++] = v;
-			}
+			checkElapsed();
+			usleep (10000);
+		}
+	}
+	
+	best = -1;
+	for (k=0; k<orderPortfolio; k++)
+		if (candidates[k].finished && (best < 0 || candidates[k].cost < candidates[best].cost))
+			best = k;
+	if (best >= 0)
+	{
+		memcpy (mapVariables+startv, candidates[best].map, numRegionVars*sizeof(int));
+		fprintf (outFile, "c o PORTFOLIO-ENGINE=%s\n", portfolioEngineNames[best % PORTFOLIO_ENGINES]);
+		fprintf (outFile, "c o PORTFOLIO-SEED=%d\n", best+1);
+		fprintf (outFile, "c o PORTFOLIO-COST=%.2f\n", candidates[best].cost);
+		time (&now);
+		fprintf (outFile, "c o SORTTIME=%.1f\n", difftime (now, sortStart)); fflush (outFile);
+	}
+	for (k=0; k<orderPortfolio; k++)
+		checkFree (candidates[k].map);
+	checkFree (candidates);
+	if (best < 0)
+		sortVars4 (startv, finishv, startc, finishc);
+}
+
+/* The independent regions are the connected components of the variables
+   under "occur in the same clause". They are found with a union-find in
+   which each root is the smallest variable of its set, so that the regions
+   come out in order of their first variable; the clauses are shared out
+   between the threads and the sets are linked by compare and swap. */
+
+#define MIN_PARALLEL_UNION_CLAUSES (1<<16)
+#define UNION_BLOCK_CLAUSES 4096
+
+typedef struct UnionJobStruct
+{
+	int *parent;
+	int nextBlock, numBlocks;
+} UnionJob;
+
+int findRoot (int *parent, int v)
+{
+	int p,gp;
+	
+	while ((p = ((volatile int *)parent)[v]) != v)
+	{
+		gp = ((volatile int *)parent)[p];
+		if (gp != p)
+			__sync_bool_compare_and_swap (&parent[v], p, gp);
+		v = gp;
+	}
+	return v;
+}
+
+void unionVars (int *parent, int v1, int v2)
+{
+	int temp;
+	
+	for (;;)
+	{
+		v1 = findRoot (parent, v1);
+		v2 = findRoot (parent, v2);
+		if (v1 == v2)
+			return;
+		if (v1 < v2)
+		{
+			temp = v1;
+			v1 = v2;
+			v2 = temp;
+		}
+		if (__sync_bool_compare_and_swap (&parent[v1], v1, v2))
+			return;
+	}
+}
+
+void *unionClauses (void *arg)
+{
+	UnionJob *job = (UnionJob *) arg;
+	ClausePtr clause;
+	int b,c,p,limit;
+	
+	while ((b = __sync_fetch_and_add (&job->nextBlock, 1)) < job->numBlocks)
+	{
+		limit = (b+1)*UNION_BLOCK_CLAUSES;
+		if (limit > numClauses)
+			limit = numClauses;
+		for (c=b*UNION_BLOCK_CLAUSES; c<limit; c++)
+		{
+			clause = clauses[c];
+			for (p=1; p<clause->length; p++)
+				unionVars (job->parent, abs(clause->lits[0]), abs(clause->lits[p]));
+		}
+	}
+	return NULL;
+}
+
+/* Sets regionStartc and regionFinishc from startvs and finishvs, once the
+   clauses have been sorted into region order. */
+void findRegionClauses()
+{
+	int r,c,v,startc;
+	
+	checkFree (regionStartc);
+	checkFree (regionFinishc);
+	regionStartc = checkMalloc ((1+regionsCount)*sizeof(int), "regionstartc");
+	regionFinishc = checkMalloc ((1+regionsCount)*sizeof(int), "regionfinishc");
+	startc = 0;
+	for (r=0; r<regionsCount; r++)
+	{
+		for (c=startc; c<numClauses; c++)
+		{
+			v = abs(clauses[c]->lits[0]);
+			if (v < startvs[r] || v > finishvs[r]) break;
+		}
+		regionStartc[r] = startc;
+		regionFinishc[r] = c-1;
+		startc = c;
+	}
+}
+
+void sortSubProblems()
+{
+	UnionJob job;
+	pthread_t *threads;
+	int *started, *regionOf, *fill;
+	int c,p,r,t,v,root,numThreadsUsed,countVars,largestVars,largestClauses;
+	char *inClause;
+	
+	if (numVars == 0) return;
+	
+	job.parent = checkMalloc ((1+numVars)*sizeof(int),"unionparent");
+	regionOf = checkMalloc ((1+numVars)*sizeof(int),"regionof");
+	inClause = checkMalloc ((1+numVars)*sizeof(char),"inclause");
+	for (v=1;v<=numVars; v++)
+	{
+		job.parent[v] = v;
+		regionOf[v] = -1;
+		inClause[v] = false;
+		mapVariables[v] = 0;
+	}
+	for (c=0; c<numClauses; c++)
+		for (p=0; p<clauses[c]->length; p++)
+			inClause[abs(clauses[c]->lits[p])] = true;
+	
+	job.nextBlock = 0;
+	job.numBlocks = (numClauses + UNION_BLOCK_CLAUSES - 1)/UNION_BLOCK_CLAUSES;
+	numThreadsUsed = (numClauses < MIN_PARALLEL_UNION_CLAUSES) ? 1 : numThreads;
+	threads = checkMalloc (numThreadsUsed*sizeof(pthread_t), "unionthreads");
+	started = checkMalloc (numThreadsUsed*sizeof(int), "unionstarted");
+	for (t=1; t<numThreadsUsed; t++)
+		started[t] = pthread_create (&threads[t], NULL, unionClauses, &job) == 0;
+	unionClauses (&job);
+	for (t=1; t<numThreadsUsed; t++)
+		if (started[t])
+			pthread_join (threads[t], NULL);
+	checkFree (threads);
+	checkFree (started);
+	
+	/* a variable stays if it is still in a clause or was never eliminated */
+	regionsCount = 0;
+	startvs = checkMalloc ((1+numVars)*sizeof(int),"startvs");
+	finishvs = checkMalloc ((1+numVars)*sizeof(int),"finishvs");
+	for (v=1; v<=numVars; v++)
+	{
+		if (!inClause[v] && optimised[v])
+			continue;
+		root = findRoot (job.parent, v);
+		if (regionOf[root] < 0)
+		{
+			regionOf[root] = regionsCount;
+			startvs[regionsCount++] = 0;
 		}
+		startvs[regionOf[root]]++;
+	}
+	
+	if (regionsCount == 0)
+	{
+		/* every variable has been eliminated */
+		numVars = 0;
+		checkFree (optimised);
+		checkFree (job.parent);
+		checkFree (regionOf);
+		checkFree (inClause);
+		checkFree (startvs);
+		checkFree (finishvs);
+		startvs = finishvs = NULL;
+		return;
+	}
+	
+	fill = checkMalloc (regionsCount*sizeof(int),"regionfill");
+	largestVars = 0;
+	for (r=0, countVars=0; r<regionsCount; r++)
+	{
+		if (startvs[r] > largestVars)
+			largestVars = startvs[r];
+		fill[r] = countVars;
+		countVars += startvs[r];
+		finishvs[r] = countVars;
+		startvs[r] = fill[r]+1;
+	}
+	for (v=1; v<=numVars; v++)
+		if (inClause[v] || !optimised[v])
+			mapVariables[v] = ++fill[regionOf[findRoot (job.parent, v)]];
+	
+	numVars = countVars;
+	
+	checkFree (optimised);
+	checkFree (fill);
+	checkFree (job.parent);
+	checkFree (regionOf);
+	checkFree (inClause);
+
+	remapClauses();
+	sortClauses();
+	findRegionClauses();
+	
+	if (regionsCount > 1)
+	{
+		fprintf (outFile, "c o %d independent regions found\n", regionsCount);
+		largestClauses = 0;
+		for (r=0; r<regionsCount; r++)
+			if (regionFinishc[r]-regionStartc[r]+1 > largestClauses)
+				largestClauses = regionFinishc[r]-regionStartc[r]+1;
+		fprintf (outFile, "c o LARGEST-REGION-VARIABLES=%d\n", largestVars); fflush (outFile);
+		fprintf (outFile, "c o LARGEST-REGION-CLAUSES=%d\n", largestClauses); fflush (outFile);
+	}
+	
+	for (r=0; r<regionsCount;r++)
+		if (orderPortfolio > 1 && regionFinishc[r]-regionStartc[r]+1 >= PORTFOLIO_MIN_CLAUSES)
+			portfolioSortVars (startvs[r], finishvs[r], regionStartc[r], regionFinishc[r]);
+		else
+			sortVars4(startvs[r], finishvs[r], regionStartc[r], regionFinishc[r]);
+
+	remapClauses();
+	sortClauses();
+	
+	compactClauses();
+}
+
+/* The cache holds the formula as it stands after preprocessing and ordering,
+   keyed on a hash of the raw input file and of the options that affect the
+   preprocessing. A file in the cache directory is a CacheHeader, the region
+   boundaries, the map from original to final variables (padded to an even
+   number of ints) and then the clauses in binary format. */
+
+#define CACHE_MAGIC "SUMCCAC1"
+#define CACHE_VERSION 1
+
+typedef struct CacheHeaderStruct
+{
+	char magic[8];
+	uint64_t key;
+	unsigned int originalNumVars, originalNumClauses, unusedVariables, regionsCount;
+} CacheHeader;
+
+uint64_t hashBytes (uint64_t hash, unsigned char *p, size_t size)
+{
+	uint64_t word;
+	
+	while (size >= sizeof(word))
+	{
+		memcpy (&word, p, sizeof(word));
+		hash = (hash ^ word) * 0x100000001b3ULL;
+		hash ^= hash >> 32;
+		p += sizeof(word);
+		size -= sizeof(word);
+	}
+	while (size > 0)
+	{
+		hash = (hash ^ *p++) * 0x100000001b3ULL;
+		size--;
 	}
+	return hash;
+}
+
+uint64_t hashInputFile (int fd)
+{
+	struct stat st;
+	unsigned char *data;
+	uint64_t hash;
 	
-	numVars = writePos;
+	if (fstat (fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+		return 0;
+	data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		return 0;
+	madvise (data, st.st_size, MADV_SEQUENTIAL);
+	hash = hashBytes (0xcbf29ce484222325ULL ^ st.st_size, data, st.st_size);
+	munmap (data, st.st_size);
+	return hash;
+}
+
+uint64_t cacheKey()
+{
+	int options[] = {CACHE_VERSION, backboneTime, orderPortfolio};
+	
+	return hashBytes (inputHash, (unsigned char *) options, sizeof(options));
+}
+
+size_t cacheMapInts()
+{
+	return (2*(size_t) regionsCount + 1 + (size_t) originalNumVars + 1) & ~(size_t) 1;
+}
+
+int readCachedProposition()
+{
+	char name[PATH_MAX];
+	struct stat st;
+	char *data;
+	int fd;
+	CacheHeader *header;
+	BinaryHeader *binaryHeader;
+	int *ints;
+	off_t prefix;
 	
-	checkFree (optimised);
+	if (cacheDir == NULL || noReduce)
+		return false;
 	
-	if (regionsCount > 1)
+	inputHash = hashInputFile (fileno(inFile));
+	if (inputHash == 0)
 	{
-		fprintf (outFile, "c o %d independent regions found\n", regionsCount);
+		fprintf (outFile, "c o CACHE=unavailable\n"); fflush (outFile);
+		cacheDir = NULL;
+		return false;
 	}
-	else
+	
+	snprintf (name, sizeof(name), "%s/%016llx.sumc", cacheDir, cacheKey());
+	data = MAP_FAILED;
+	fd = open (name, O_RDONLY);
+	if (fd >= 0)
 	{
-		//for (v=1; v<=numVars; v++)
-		//	mapVariables[v] = v;
+		if (fstat (fd, &st) == 0 && st.st_size >= (off_t) sizeof(CacheHeader))
+			data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close (fd);
 	}
-
-
-	remapClauses();
-
-	for (c=0;c<numClauses;c++)
+	if (data == MAP_FAILED)
 	{
-		clause = clauses[c];
-		qsort (clause->lits, clause->length, sizeof(int), litCompare);
+		fprintf (outFile, "c o CACHE=miss\n"); fflush (outFile);
+		return false;
 	}
-
-
-	qsort (clauses, numClauses, sizeof (ClausePtr), clauseCompare);
 	
-
-	startc=0;
-	for (r=0; r<regionsCount;r++)
+	header = (CacheHeader *) data;
+	binaryHeader = NULL;
+	if (memcmp (header->magic, CACHE_MAGIC, sizeof(header->magic)) == 0 && header->key == cacheKey() &&
+		header->originalNumVars < INT_MAX && header->originalNumClauses <= INT_MAX && header->regionsCount <= header->originalNumVars + 1)
 	{
-		for (c=startc; c<numClauses; c++)
-		{
-			clause = clauses[c];
-			v = abs(clause->lits[0]);
-			if (v < startvs[r] || v > finishvs[r]) break;
-		}
-		finishc = c-1;
-		
-		//sortVars (startvs[r], finishvs[r], startc, finishc);
-		sortVars4(startvs[r], finishvs[r], startc, finishc);
-		
-		startc = finishc+1;
+		originalNumVars = header->originalNumVars;
+		regionsCount = header->regionsCount;
+		prefix = (off_t) (sizeof(CacheHeader) + cacheMapInts()*sizeof(int));
+		if (prefix <= st.st_size)
+			binaryHeader = checkBinaryProposition (data + prefix, (size_t) (st.st_size - prefix));
 	}
-
-	remapClauses();
-
-	for (c=0;c<numClauses;c++)
+	if (binaryHeader == NULL || binaryHeader->numVars > (unsigned int) originalNumVars)
 	{
-		clause = clauses[c];
-		qsort (clause->lits, clause->length, sizeof(int), litCompare);
+		munmap (data, st.st_size);
+		fprintf (outFile, "c o CACHE=miss\n"); fflush (outFile);
+		return false;
 	}
-
-	qsort (clauses, numClauses, sizeof (ClausePtr), clauseCompare);
 	
+	originalNumClauses = header->originalNumClauses;
+	initProposition();
+	if (binaryHeader->numClauses > (unsigned int) originalNumClauses)
+		clauses = checkRealloc (clauses, binaryHeader->numClauses*sizeof(ClausePtr), "clauses");
+	decodeBinaryClauses (binaryHeader);
+	numVars = binaryHeader->numVars;
+	unusedVariables = header->unusedVariables;
+	
+	ints = (int *) (header + 1);
+	startvs = checkMalloc ((1+regionsCount)*sizeof(int),"startvs");
+	finishvs = checkMalloc ((1+regionsCount)*sizeof(int),"finishvs");
+	variableMap = checkMalloc ((1+originalNumVars)*sizeof(int),"variablemap");
+	memcpy (startvs, ints, regionsCount*sizeof(int));
+	memcpy (finishvs, ints + regionsCount, regionsCount*sizeof(int));
+	memcpy (variableMap, ints + 2*regionsCount, (1+originalNumVars)*sizeof(int));
+	
+	munmap (data, st.st_size);
+	fprintf (outFile, "c o CACHE=hit\n"); fflush (outFile);
+	return true;
+}
+
+void writeCachedProposition()
+{
+	char name[PATH_MAX], tempName[PATH_MAX+32];
+	FILE *f;
+	CacheHeader header;
+	int v, pad = 0;
+	
+	if (cacheDir == NULL)
+		return;
+	
+	snprintf (name, sizeof(name), "%s/%016llx.sumc", cacheDir, cacheKey());
+	snprintf (tempName, sizeof(tempName), "%s.%d.tmp", name, (int) getpid());
+	f = fopen (tempName, "wb");
+	if (f == NULL)
+	{
+		fprintf (outFile, "c o CACHE-CANT-WRITE=<%s>\n", tempName); fflush (outFile);
+		return;
+	}
 	
-	freeVarToClause();
-	checkFree (isUsed);
-	checkFree (varsUsed);
-	checkFree (startvs);
-	checkFree (finishvs);
+	memset (&header, 0, sizeof(header));
+	memcpy (header.magic, CACHE_MAGIC, sizeof(header.magic));
+	header.key = cacheKey();
+	header.originalNumVars = originalNumVars;
+	header.originalNumClauses = originalNumClauses;
+	header.unusedVariables = unusedVariables;
+	header.regionsCount = regionsCount;
+	fwrite (&header, sizeof(header), 1, f);
+	fwrite (startvs, sizeof(int), regionsCount, f);
+	fwrite (finishvs, sizeof(int), regionsCount, f);
+	if (variableMap != NULL)
+		fwrite (variableMap, sizeof(int), 1+originalNumVars, f);
+	else
+		for (v=0; v<=originalNumVars; v++)
+			fwrite (&v, sizeof(int), 1, f);
+	if (cacheMapInts() > 2*(size_t) regionsCount + 1 + (size_t) originalNumVars)
+		fwrite (&pad, sizeof(int), 1, f);
+	fwriteBinaryProposition (f, numVars, numClauses, numClauses, clauses);
+	
+	if (ferror (f) | (fclose (f) != 0) || rename (tempName, name) != 0)
+	{
+		unlink (tempName);
+		fprintf (outFile, "c o CACHE-CANT-WRITE=<%s>\n", name); fflush (outFile);
+	}
+	else
+	{
+		fprintf (outFile, "c o CACHE=stored\n"); fflush (outFile);
+	}
 }
 
 void sortVarsAndClauses()
@@ -2993,8 +6620,8 @@ void printProgress()
 		fprintf(outFile, "ce time %.0f(s) pos %d ", difftime(timeNow,startTime),pos);
 		if (pos > 0)
 		{
-			fprintClause(outFile, clauses[pos]);
-			fprintf (outFile, "(c %d) nodes %d (%d)\n", clauses[pos]->bitSet->capacity,blockListSize(clauseSet), bitSetCount);
+			fprintClause(outFile, clauseAt(pos));
+			fprintf (outFile, "(c %d) nodes %d (%d)\n", clauseAt(pos)->bitSet->capacity,blockListSize(clauseSet), bitSetCount);
 		}
 		else
 			fprintf(outFile,"\n");
@@ -3021,7 +6648,7 @@ void printProgress()
 			{
 				fprintf(outFile, "ce %d nodes (%d)\n", blockListSize (clauseSet),bitSetCount);
 				fprintf(outFile, "ce clause number %d ", pos);
-				fprintClause (outFile,clauses[pos]);
+				fprintClause (outFile,clauseAt(pos));
 				fprintf (outFile,"\n");
 				processBar ("clauses", pos, numClauses);
 			}
@@ -3032,7 +6659,7 @@ void printProgress()
 			processBar ("cpu", (int) getCPUTimeSinceStart(), cpuLimit);
 		if (memoryLimit > 0)
 		{
-			processBar ("memory", megaBytes, 1024*memoryLimit);
+			processBar ("memory", megaBytes, memoryLimitMegaBytes);
 		}
 		fflush (outFile);
 	}
@@ -3212,6 +6839,138 @@ TreeNodePtr addClauseToTree (TreeNodePtr tn, ClausePtr clause)
 	return addClausetToTreeSub (tn, clause, 0);
 }
 
+/* In streaming mode the ordered clauses are written to a temporary file at
+   the start of the sweep and only a window of streamWindow clauses from pos
+   onwards is kept in memory, each with its bitset. The occurrences of each
+   variable in the window are chained from earlier clauses to later ones, so
+   that getTreeNode can find the later clauses sharing a variable with the
+   current one. Checking against only the clauses in the window is safe
+   since any term kept which a later clause would have pruned cancels when
+   that clause is reached. */
+
+typedef struct StreamSlotStruct
+{
+	Clause clause;
+	int *next, capacity;
+} StreamSlot, *StreamSlotPtr;
+
+int streamLoaded;
+FILE *streamFile;
+StreamSlotPtr streamSlots;
+int *streamTail, *streamTailIndex;
+
+ClausePtr clauseAt (int c)
+{
+	if (streamWindow > 0)
+		return &streamSlots[c % streamWindow].clause;
+	else
+		return clauses[c];
+}
+
+void loadStreamClause()
+{
+	StreamSlotPtr slot = &streamSlots[streamLoaded % streamWindow];
+	ClausePtr clause = &slot->clause;
+	int length, i, var, c = streamLoaded;
+	
+	if (fread (&length, sizeof(int), 1, streamFile) != 1 || length < 0)
+	{
+		fprintf (outFile, "c Error - could not read clause stream\n");
+		printFinal (STATUS_SYNTAX_ERROR);
+	}
+	if (length > slot->capacity)
+	{
+		if (slot->capacity > 0)
+		{
+			checkFree (clause->lits);
+			checkFree (slot->next);
+		}
+		slot->capacity = length;
+		clause->lits = checkMalloc (length*sizeof(int), "streamlits");
+		slot->next = checkMalloc (length*sizeof(int), "streamnext");
+	}
+	if (fread (clause->lits, sizeof(int), length, streamFile) != (size_t) length)
+	{
+		fprintf (outFile, "c Error - could not read clause stream\n");
+		printFinal (STATUS_SYNTAX_ERROR);
+	}
+	clause->length = length;
+	clause->redundant = false;
+	clause->pos = c;
+	clause->posAdded = -1;
+	clause->bitSet = clauseToBitSet (clause);
+	
+	for (i=0; i<length; i++)
+	{
+		var = abs(clause->lits[i]);
+		slot->next[i] = -1;
+		if (streamTail[var] >= 0)
+			streamSlots[streamTail[var] % streamWindow].next[streamTailIndex[var]] = c;
+		streamTail[var] = c;
+		streamTailIndex[var] = i;
+	}
+	streamLoaded++;
+}
+
+void startClauseStream()
+{
+	int c, v;
+	ClausePtr clause;
+	
+	fprintf (outFile, "c o STREAM-WINDOW=%d\n", streamWindow); fflush (outFile);
+	streamFile = tmpfile();
+	if (streamFile == NULL)
+	{
+		fprintf (outFile, "c Error - could not create clause stream\n");
+		printFinal (STATUS_SYNTAX_ERROR);
+	}
+	for (c=0; c<numClauses; c++)
+	{
+		clause = clauses[c];
+		fwrite (&clause->length, sizeof(int), 1, streamFile);
+		fwrite (clause->lits, sizeof(int), clause->length, streamFile);
+		freeClause (clause);
+	}
+	if (fflush (streamFile) != 0 || ferror (streamFile))
+	{
+		fprintf (outFile, "c Error - could not write clause stream\n");
+		printFinal (STATUS_SYNTAX_ERROR);
+	}
+	rewind (streamFile);
+	freeClauseStore (&clauseStore);
+	checkFree (clauses);
+	clauses = NULL;
+	
+	streamSlots = checkMalloc (streamWindow*sizeof(StreamSlot), "streamslots");
+	for (c=0; c<streamWindow; c++)
+		streamSlots[c].capacity = 0;
+	streamTail = checkMalloc ((1+numVars)*sizeof(int), "streamtail");
+	streamTailIndex = checkMalloc ((1+numVars)*sizeof(int), "streamtailindex");
+	for (v=1; v<=numVars; v++)
+		streamTail[v] = -1;
+	streamLoaded = 0;
+	while (streamLoaded < numClauses && streamLoaded < streamWindow)
+		loadStreamClause();
+}
+
+/* Drops the clause at pos from the window and reads the next one in. */
+void advanceClauseStream()
+{
+	ClausePtr clause = clauseAt (pos);
+	int i, var;
+	
+	for (i=0; i<clause->length; i++)
+	{
+		var = abs(clause->lits[i]);
+		if (streamTail[var] == pos)
+			streamTail[var] = -1;
+	}
+	bitSetcheckFree (clause->bitSet);
+	clause->bitSet = NULL;
+	if (streamLoaded < numClauses)
+		loadStreamClause();
+}
+
 ClausePtr clausesToCheck[100];
 int countClausesToCheck;
 
@@ -3219,13 +6978,30 @@ TreeNodePtr getTreeNode (int pos, BitSetPtr thisBitSet, BitSetPtr negBitSet)
 {
 	TreeNodePtr result;
 	ClausePtr clause,other;
-	int p,lit;
+	int p,lit,c,index;
 	BlockListPtr blp;
 	
 	result = NULL;
 	
-	clause = clauses[pos];
+	clause = clauseAt(pos);
 	int count = 0;
+	if (streamWindow > 0)
+	{
+		for (p=0; p<clause->length; p++)
+			for (c=streamSlots[pos % streamWindow].next[p]; c >= 0; c=streamSlots[c % streamWindow].next[index])
+			{
+				other = clauseAt(c);
+				for (index=0; abs(other->lits[index]) != abs(clause->lits[p]); index++);
+				if (other->posAdded < pos && !bitSetIntersects (negBitSet, other->bitSet))
+				{
+					result = addClauseToTree (result, other);
+					other->posAdded = pos;
+					count++;
+				}
+			}
+		return result;
+	}
+	
 	for (p=0; p<clause->length; p++)
 	{
 		blp = varToClause[abs(clause->lits[p])];
@@ -3282,7 +7058,7 @@ void checkMemory()
 	
 	if (memoryLimit > 0)
 	{
-		if (gigaBytes >= memoryLimit)
+		if (megaBytes >= memoryLimitMegaBytes)
 		{
 			memoryReason = "limit reached";
 			printFinal (STATUS_OUT_OF_MEMORY);
@@ -3440,10 +7216,468 @@ void mainBlock (BitSetPtr otherBitSet)
 }
 
 
+/* Regions which are copies of an earlier region up to a renaming of the
+   variables have the same count, so the sweep counts only the first of each
+   class and multiplies by its count when it reaches the others. Candidates
+   are found by hashing a few rounds of colour refinement of the clause and
+   variable incidence, and then checked by mapping the variables in order of
+   colour and comparing the sorted clauses. */
+
+#define REGION_REFINEMENT_ROUNDS	4
+
+int *regionClass, nextRegion;
+mpz_t *regionCounts, regionBase;
+uint64_t *varColour;
+int *isoLits, *isoStart;
+
+uint64_t mixHash (uint64_t a, uint64_t b)
+{
+	a = (a ^ b) * 0x9e3779b97f4a7c15ULL;
+	return a ^ (a >> 29);
+}
+
+int isoClauseCompare (const void *a, const void *b)
+{
+	int *lits1 = isoLits + isoStart[*(int *)a], *lits2 = isoLits + isoStart[*(int *)b];
+	int l1 = isoStart[*(int *)a+1] - isoStart[*(int *)a], l2 = isoStart[*(int *)b+1] - isoStart[*(int *)b], p;
+	
+	if (l1 != l2)
+		return l1 - l2;
+	for (p=0; p<l1; p++)
+		if (lits1[p] != lits2[p])
+			return lits1[p] - lits2[p];
+	return 0;
+}
+
+int varColourCompare (const void *a, const void *b)
+{
+	int v1 = *(int *)a, v2 = *(int *)b;
+	
+	if (varColour[v1] != varColour[v2])
+		return (varColour[v1] < varColour[v2]) ? -1 : 1;
+	return v1 - v2;
+}
+
+/* Writes the clauses of region r, with each variable replaced by map[var],
+   into isoLits in sorted order, and returns the order of the clauses. */
+int *sortedRegionClauses (int r, int *map, int *lits)
+{
+	int c,p,n,*order;
+	ClausePtr clause;
+	
+	n = regionFinishc[r] - regionStartc[r] + 1;
+	order = checkMalloc (n*sizeof(int), "isoorder");
+	isoStart[0] = 0;
+	for (c=0; c<n; c++)
+	{
+		clause = clauses[regionStartc[r]+c];
+		for (p=0; p<clause->length; p++)
+			lits[isoStart[c]+p] = (clause->lits[p] > 0) ? map[clause->lits[p]] : -map[-clause->lits[p]];
+		sortLits (&normaliser, lits + isoStart[c], clause->length);
+		isoStart[c+1] = isoStart[c] + clause->length;
+		order[c] = c;
+	}
+	isoLits = lits;
+	qsort (order, n, sizeof(int), isoClauseCompare);
+	return order;
+}
+
+/* Returns whether region r2 is region r1 with the variables renamed. */
+int regionsIsomorphic (int r1, int r2)
+{
+	int v,c,n,numRegionVars,result,*vars1,*vars2,*map,*lits1,*lits2,*order1,*order2,*start1;
+	size_t numLits;
+	
+	numRegionVars = finishvs[r1] - startvs[r1] + 1;
+	n = regionFinishc[r1] - regionStartc[r1] + 1;
+	for (numLits=0, c=regionStartc[r1]; c<=regionFinishc[r1]; c++)
+		numLits += clauses[c]->length;
+	vars1 = checkMalloc (numRegionVars*sizeof(int), "isovars");
+	vars2 = checkMalloc (numRegionVars*sizeof(int), "isovars");
+	map = checkMalloc ((1+numVars)*sizeof(int), "isomap");
+	for (v=0; v<numRegionVars; v++)
+	{
+		vars1[v] = startvs[r1]+v;
+		vars2[v] = startvs[r2]+v;
+	}
+	qsort (vars1, numRegionVars, sizeof(int), varColourCompare);
+	qsort (vars2, numRegionVars, sizeof(int), varColourCompare);
+	for (v=1; v<=numVars; v++)
+		map[v] = v;
+	for (v=0; v<numRegionVars; v++)
+		map[vars1[v]] = vars2[v];
+	
+	lits1 = checkMalloc ((numLits+1)*sizeof(int), "isolits");
+	lits2 = checkMalloc ((numLits+1)*sizeof(int), "isolits");
+	isoStart = checkMalloc ((n+1)*sizeof(int), "isostart");
+	start1 = checkMalloc ((n+1)*sizeof(int), "isostart");
+	order1 = sortedRegionClauses (r1, map, lits1);
+	memcpy (start1, isoStart, (n+1)*sizeof(int));
+	for (v=1; v<=numVars; v++)
+		map[v] = v;
+	order2 = sortedRegionClauses (r2, map, lits2);
+	
+	result = true;
+	for (c=0; c<n && result; c++)
+	{
+		if (start1[order1[c]+1] - start1[order1[c]] != isoStart[order2[c]+1] - isoStart[order2[c]] ||
+			memcmp (lits1 + start1[order1[c]], lits2 + isoStart[order2[c]],
+				(isoStart[order2[c]+1] - isoStart[order2[c]])*sizeof(int)) != 0)
+			result = false;
+	}
+	
+	checkFree (vars1);
+	checkFree (vars2);
+	checkFree (map);
+	checkFree (lits1);
+	checkFree (lits2);
+	checkFree (isoStart);
+	checkFree (start1);
+	checkFree (order1);
+	checkFree (order2);
+	return result;
+}
+
+void findIsomorphicRegions()
+{
+	uint64_t *clauseColour, *newColour, *regionHash;
+	int r,r2,c,p,v,round,copies = 0,classes = 0;
+	ClausePtr clause;
+	
+	regionClass = NULL;
+	if (regionsCount < 2)
+		return;
+	
+	varColour = checkMalloc ((1+numVars)*sizeof(uint64_t), "varcolour");
+	newColour = checkMalloc ((1+numVars)*sizeof(uint64_t), "newcolour");
+	clauseColour = checkMalloc ((numClauses+1)*sizeof(uint64_t), "clausecolour");
+	regionHash = checkMalloc (regionsCount*sizeof(uint64_t), "regionhash");
+	for (v=1; v<=numVars; v++)
+		varColour[v] = 1;
+	for (round=0; round<REGION_REFINEMENT_ROUNDS; round++)
+	{
+		for (v=1; v<=numVars; v++)
+			newColour[v] = varColour[v];
+		for (c=0; c<numClauses; c++)
+		{
+			clause = clauses[c];
+			clauseColour[c] = mixHash (clause->length, 0);
+			for (p=0; p<clause->length; p++)
+				clauseColour[c] += mixHash (varColour[abs(clause->lits[p])], clause->lits[p] > 0);
+			for (p=0; p<clause->length; p++)
+				newColour[abs(clause->lits[p])] += mixHash (clauseColour[c], clause->lits[p] > 0);
+		}
+		for (v=1; v<=numVars; v++)
+			varColour[v] = mixHash (newColour[v], round);
+	}
+	for (r=0; r<regionsCount; r++)
+	{
+		regionHash[r] = mixHash (finishvs[r]-startvs[r], regionFinishc[r]-regionStartc[r]);
+		for (c=regionStartc[r]; c<=regionFinishc[r]; c++)
+			regionHash[r] += mixHash (clauseColour[c], 0);
+	}
+	checkFree (newColour);
+	checkFree (clauseColour);
+	
+	regionClass = checkMalloc (regionsCount*sizeof(int), "regionclass");
+	regionCounts = checkMalloc (regionsCount*sizeof(mpz_t), "regioncounts");
+	for (r=0; r<regionsCount; r++)
+	{
+		regionClass[r] = r;
+		for (r2=0; r2<r && regionClass[r] == r; r2++)
+			if (regionClass[r2] == r2 && regionHash[r2] == regionHash[r] &&
+				finishvs[r2]-startvs[r2] == finishvs[r]-startvs[r] &&
+				regionFinishc[r2]-regionStartc[r2] == regionFinishc[r]-regionStartc[r] &&
+				regionsIsomorphic (r2, r))
+				regionClass[r] = r2;
+		if (regionClass[r] == r)
+		{
+			mpz_init (regionCounts[r]);
+			classes++;
+		}
+		else
+			copies++;
+	}
+	mpz_init (regionBase);
+	checkFree (varColour);
+	checkFree (regionHash);
+	
+	fprintf (outFile, "c o REGION-CLASSES=%d\n", classes); fflush (outFile);
+	fprintf (outFile, "c o ISOMORPHIC-REGIONS=%d\n", copies); fflush (outFile);
+}
+
+/* The frontier is kept as a product of independent groups. Two variables in
+   the frontier are in the same group when the clauses swept so far connect
+   them. Variables in different groups cannot yet be correlated, so the
+   frontier is the product of the frontiers of the groups. Each step works
+   only on the group of its clause. When a clause joins several groups, they
+   are first multiplied out, and a group whose variables are all finished is
+   folded into sweepProduct. The empty set is shared by all the groups, so
+   its contribution is swapped in and out of a group's emptyContribution as
+   the group is worked on. */
+
+#define MERGE_STAMP -2
+
+typedef struct FrontierGroupStruct
+{
+	BlockListPtr set;
+	mpz_t emptyContribution;
+	int activeVars, parent, live;
+} FrontierGroup;
+
+FrontierGroup *frontierGroups;
+int *varGroup, *liveGroupIds, numFrontierGroups, liveGroups, maxLiveGroups, frontierMerges;
+BlockListPtr spareSet, *freeSets;
+int numFreeSets;
+mpz_t sweepProduct, productTemp;
+
+int findGroup (int g)
+{
+	while (frontierGroups[g].parent != g)
+	{
+		frontierGroups[g].parent = frontierGroups[frontierGroups[g].parent].parent;
+		g = frontierGroups[g].parent;
+	}
+	return g;
+}
+
+int newFrontierGroup()
+{
+	FrontierGroup *group;
+	int g = numFrontierGroups++;
+	
+	group = &frontierGroups[g];
+	group->set = (numFreeSets > 0) ? freeSets[--numFreeSets] : newBlockList (1000);
+	mpz_init_set_ui (group->emptyContribution, 1);
+	addToBlockList (group->set, emptyBitSet);
+	group->activeVars = 0;
+	group->parent = g;
+	group->live = liveGroups;
+	liveGroupIds[liveGroups++] = g;
+	if (liveGroups > maxLiveGroups)
+		maxLiveGroups = liveGroups;
+	return g;
+}
+
+void freeFrontierGroup (int g)
+{
+	FrontierGroup *group = &frontierGroups[g];
+	
+	clearBlockList (group->set);
+	freeSets[numFreeSets++] = group->set;
+	group->set = NULL;
+	mpz_clear (group->emptyContribution);
+	liveGroupIds[group->live] = liveGroupIds[--liveGroups];
+	frontierGroups[liveGroupIds[group->live]].live = group->live;
+}
+
+void bitSetStash (BitSetPtr bs)
+{
+	mpz_set (bs->previousContribution, bs->contribution);
+	mpz_set_ui (bs->contribution, 0);
+}
+
+void addToProduct (BlockListPtr product, BitSetPtr bs, mpz_t c1, mpz_t c2)
+{
+	mpz_mul (productTemp, c1, c2);
+	if (mpz_sgn (productTemp) == 0)
+		return;
+	if (bs->posAdded == MERGE_STAMP)
+		mpz_add (bs->contribution, bs->contribution, productTemp);
+	else
+	{
+		mpz_set (bs->contribution, productTemp);
+		bs->posAdded = MERGE_STAMP;
+		addToBlockList (product, bs);
+	}
+}
+
+void bitSetClearStamp (BitSetPtr bs)
+{
+	bs->posAdded = -1;
+}
+
+/* Replaces groups g1 and g2, neither being worked on, by their product and
+   returns the group that holds it. */
+int multiplyFrontierGroups (int g1, int g2)
+{
+	FrontierGroup *group1 = &frontierGroups[g1], *group2 = &frontierGroups[g2];
+	BitSetPtr bs1, bs2, unionBitSet;
+	BlockListPtr product;
+	mpz_t empty1, empty2;
+	
+	frontierMerges++;
+	mpz_init_set (empty1, group1->emptyContribution);
+	mpz_init_set (empty2, group2->emptyContribution);
+	mapBlockList (group1->set, bitSetStash);
+	mapBlockList (group2->set, bitSetStash);
+	product = spareSet;
+	
+	addToProduct (product, emptyBitSet, empty1, empty2);
+	startScanBlockList (group1->set);
+	while (hasNextBlockList (group1->set))
+	{
+		bs1 = (BitSetPtr) getNextBlockList (group1->set);
+		if (bs1 != emptyBitSet)
+			addToProduct (product, bs1, bs1->previousContribution, empty2);
+	}
+	startScanBlockList (group2->set);
+	while (hasNextBlockList (group2->set))
+	{
+		bs2 = (BitSetPtr) getNextBlockList (group2->set);
+		if (bs2 != emptyBitSet)
+			addToProduct (product, bs2, empty1, bs2->previousContribution);
+	}
+	startScanBlockList (group1->set);
+	while (hasNextBlockList (group1->set))
+	{
+		bs1 = (BitSetPtr) getNextBlockList (group1->set);
+		if (bs1 == emptyBitSet || mpz_sgn (bs1->previousContribution) == 0)
+			continue;
+		startScanBlockList (group2->set);
+		while (hasNextBlockList (group2->set))
+		{
+			bs2 = (BitSetPtr) getNextBlockList (group2->set);
+			if (bs2 == emptyBitSet || mpz_sgn (bs2->previousContribution) == 0)
+				continue;
+			bitSetCopyOr (fullNextClause, bs1, bs2);
+			unionBitSet = bitSetGetUnique (fullNextClause);
+			if (unionBitSet == fullNextClause)
+				fullNextClause = newBitSet();
+			addToProduct (product, unionBitSet, bs1->previousContribution, bs2->previousContribution);
+		}
+	}
+	mapBlockList (product, bitSetClearStamp);
+	
+	/* the empty set's share stays in the group until it is worked on */
+	mpz_swap (group1->emptyContribution, emptyBitSet->contribution);
+	mpz_set_ui (emptyBitSet->contribution, 0);
+	
+	clearBlockList (group1->set);
+	spareSet = group1->set;
+	group1->set = product;
+	group1->activeVars += group2->activeVars;
+	group2->parent = g1;
+	freeFrontierGroup (g2);
+	mpz_clear (empty1);
+	mpz_clear (empty2);
+	return g1;
+}
+
+/* Finds the group for the clause at pos, multiplying out the groups that
+   it joins, and adds the variables that start here to it. */
+int frontierGroupAt (ClausePtr clause)
+{
+	int g,h,p,*varp;
+	
+	g = -1;
+	for (p=0; p<clause->length; p++)
+	{
+		if (varGroup[abs(clause->lits[p])] < 0)
+			continue;
+		h = findGroup (varGroup[abs(clause->lits[p])]);
+		if (g < 0)
+			g = h;
+		else if (h != g)
+			g = multiplyFrontierGroups (g, h);
+	}
+	if (g < 0)
+		g = newFrontierGroup();
+	for (varp=firstVars[pos]; *varp != 0; varp++)
+	{
+		varGroup[*varp] = g;
+		frontierGroups[g].activeVars++;
+	}
+	return g;
+}
+
+void initFrontierGroups()
+{
+	int v;
+	
+	frontierGroups = checkMalloc ((1+numClauses)*sizeof(FrontierGroup), "frontiergroups");
+	liveGroupIds = checkMalloc ((1+numClauses)*sizeof(int), "livegroups");
+	freeSets = checkMalloc ((1+numClauses)*sizeof(BlockListPtr), "freesets");
+	varGroup = checkMalloc ((1+numVars)*sizeof(int), "vargroup");
+	for (v=1; v<=numVars; v++)
+		varGroup[v] = -1;
+	numFrontierGroups = liveGroups = maxLiveGroups = frontierMerges = 0;
+	spareSet = newBlockList (50000);
+	freeSets[0] = newBlockList (50000);
+	numFreeSets = 1;
+	mpz_init_set_ui (sweepProduct, 1);
+	mpz_init (productTemp);
+	mpz_set_ui (emptyBitSet->contribution, 0);
+}
+
+/* Ends the step at pos on group g, folding the group into sweepProduct if
+   none of its variables are left. */
+void endFrontierStep (int g)
+{
+	FrontierGroup *group = &frontierGroups[g];
+	
+	group->set = clauseSet;
+	group->activeVars -= intListSize (lastVars[pos]);
+	if (group->activeVars == 0)
+	{
+		if (blockListSize (group->set) == 0)
+			mpz_set_ui (sweepProduct, 0);
+		else
+			mpz_mul (sweepProduct, sweepProduct, emptyBitSet->contribution);
+		mpz_set_ui (emptyBitSet->contribution, 0);
+		freeFrontierGroup (g);
+	}
+	else
+		mpz_swap (emptyBitSet->contribution, group->emptyContribution);
+}
+
+/* Called at the start of each step of the sweep. At the first clause of a
+   region every frontier group has been folded into sweepProduct, which is
+   the count so far; the count of a region is the ratio between the values
+   at its two ends, and a copy is passed over by multiplying by it. */
+void reuseIsomorphicRegions (char *processedVariables)
+{
+	int r,p,*varp;
+	
+	while (regionClass != NULL && nextRegion < regionsCount && pos == regionStartc[nextRegion])
+	{
+		if (liveGroups != 0)
+		{
+			nextRegion = regionsCount;
+			return;
+		}
+		r = nextRegion++;
+		if (r > 0 && regionClass[r-1] == r-1)
+		{
+			if (mpz_sgn (regionBase) == 0)
+				mpz_set_ui (regionCounts[r-1], 0);
+			else
+				mpz_divexact (regionCounts[r-1], sweepProduct, regionBase);
+		}
+		if (regionClass[r] != r)
+		{
+			mpz_mul (sweepProduct, sweepProduct, regionCounts[regionClass[r]]);
+			for (p=pos; p<=regionFinishc[r]; p++)
+			{
+				for (varp=lastVars[p]; *varp != 0; varp++)
+					processedVariables[*varp] = 1;
+				if (streamWindow > 0)
+				{
+					pos = p;
+					advanceClauseStream();
+				}
+			}
+			pos = regionFinishc[r]+1;
+		}
+		else
+			mpz_set (regionBase, sweepProduct);
+	}
+}
+
 void buildLists()
 {
-	BlockListPtr tempClauseSet, blockList1, blockList2;
-	int c, v;
+	BlockListPtr tempClauseSet;
+	int c, v, g, thisGroup;
 	BitSetPtr otherBitSet, reducedBitSet;
 	ClausePtr thisClause;
 	char * processedVariables;
@@ -3454,41 +7688,41 @@ void buildLists()
 	int lastProcessedRange = 0;
 	int longEnd;
 	
-	
-	
-	mpz_t bigOne;
-	
-	setUpVarToClause();
 	processedVariables = checkMalloc ((2+numVars)*sizeof(char),"processedvariables");
 	for (v=1;v<=numVars+1;v++)
 		processedVariables[v] = 0;
 	
-	for (c=0; c<numClauses; c++)
+	setupFirstAndLastVars();
+	if (regionStartc == NULL)
+		findRegionClauses();
+	if (regionClass == NULL)
+		findIsomorphicRegions();
+	nextRegion = 0;
+	
+	if (streamWindow > 0)
+		startClauseStream();
+	else
 	{
-		clauses[c]->bitSet = clauseToBitSet(clauses[c]);
-		clauses[c]->pos = c;
+		setUpVarToClause();
+		for (c=0; c<numClauses; c++)
+		{
+			clauses[c]->bitSet = clauseToBitSet(clauses[c]);
+			clauses[c]->pos = c;
+		}
 	}
 	
-	
 	negBitSet = newBitSet();
-
-	setupFirstAndLastVars();
-	
-	mpz_init (bigOne);
-	mpz_set_ui (bigOne, 1);
 	
-	bitSetSetContribution (emptyBitSet, bigOne);
 	emptyBitSet->posAdded = -1;
+	initFrontierGroups();
+	clauseSet = spareSet;
 	
-	blockList1 = newBlockList(50000);
-	blockList2 = newBlockList (50000);
-	clauseSet = blockList1;
-	nextClauseSet = blockList2;
-	
-	addToBlockList (clauseSet, emptyBitSet);
 	fullNextClause = newBitSet();
 	for (pos=0; pos<numClauses; pos++)
 	{
+		reuseIsomorphicRegions (processedVariables);
+		if (pos == numClauses)
+			break;
 		
 		if (traceLevel > 0)
 			printProgress ();
@@ -3496,6 +7730,11 @@ void buildLists()
 		checkElapsed();
 		//checkMemory();
 		
+		thisGroup = frontierGroupAt (clauseAt(pos));
+		mpz_swap (emptyBitSet->contribution, frontierGroups[thisGroup].emptyContribution);
+		clauseSet = frontierGroups[thisGroup].set;
+		nextClauseSet = spareSet;
+		
 		if (traceLevel &eachPosClausesTrace)
 		{
 			mapBlockList (clauseSet, tracePrintBitSet);
@@ -3532,7 +7771,7 @@ void buildLists()
 			fprintf (outFile, "--------------------\n\n");
 		}
 		
-		thisClause = clauses[pos];
+		thisClause = clauseAt(pos);
 		currentClause = thisClause;
 		thisBitSet = thisClause->bitSet;
 		bitSetMakeNegBitSet (negBitSet, thisBitSet);
@@ -3592,14 +7831,17 @@ void buildLists()
 			unusedWords = localUnusedWords;
 			wordsToLose = unusedWords - lastUnusedWords;
 			mapBlockList (nextClauseSet, bitSetReduce);
+			for (g=0; g<liveGroups; g++)
+				if (liveGroupIds[g] != thisGroup)
+					mapBlockList (frontierGroups[liveGroupIds[g]].set, bitSetReduce);
 			bitSetReduce(emptyBitSet);
 			//bitSetReduce(negBitSet);
 			bitSetReduce(fullNextClause);
 			//bitSetReduce(otherBitSet);
 			bitSetReduce(other);
 			
-			for (v=pos+1; v<numClauses; v++)
-				bitSetReduce (clauses[v]->bitSet);
+			for (v=pos+1; v<((streamWindow > 0) ? streamLoaded : numClauses); v++)
+				bitSetReduce (clauseAt(v)->bitSet);
 			
 			lastUnusedWords = unusedWords;
 			wordsToLose = 0;
@@ -3609,19 +7851,333 @@ void buildLists()
 		bitSetFreeBitSetsBeginningWith (lastVars[pos]);
 
 		freeTreeNode (thisTree);
+		if (streamWindow > 0)
+			advanceClauseStream();
 		
+		if (nextClauseSet != clauseSet)
+		{
+			clearBlockList (clauseSet);
+			spareSet = clauseSet;
+		}
 		clauseSet = nextClauseSet;
-		if (clauseSet == blockList1)
-			nextClauseSet = blockList2;
-		else
-			nextClauseSet = blockList1;
-		clearBlockList (nextClauseSet);
+		endFrontierStep (thisGroup);
 		
 		//clearUnusedBitSets(); // Takes more time than it's worth
 		
 
 		
 	}
+	
+	clauseSet = spareSet;
+	clearBlockList (clauseSet);
+	addToBlockList (clauseSet, emptyBitSet);
+	mpz_set (emptyBitSet->contribution, sweepProduct);
+	fprintf (outFile, "c o MAX-FRONTIER-GROUPS=%d\n", maxLiveGroups); fflush (outFile);
+	fprintf (outFile, "c o FRONTIER-MERGES=%d\n", frontierMerges); fflush (outFile);
+}
+
+/* Regions with at least regionSweepClauses clauses are counted by sweeps of
+   their own in child processes, since the sweep keeps its state in globals;
+   up to numThreads run at a time, the most literals first, and only one
+   region of each isomorphism class is counted. The child renumbers its
+   region from 1 so that its bit sets are only as wide as the region, and
+   hands its count back through a temporary file by way of printFinal. The
+   smaller regions are swept together in this process as before, and the
+   counts are multiplied at the end. This is only done with more than one
+   thread. The memory left under the limit when the workers start is shared
+   equally between them and this process; time limits apply to each process
+   separately. A region whose worker cannot be started is counted here. */
+
+typedef struct RegionJobStruct
+{
+	int region, multiplicity;
+	long cost;
+	pid_t pid;
+	FILE *result;
+} RegionJob;
+
+RegionJob *regionJobs;
+int numRegionJobs;
+
+int regionJobCompare (const void *a, const void *b)
+{
+	long c1 = ((RegionJob *)a)->cost, c2 = ((RegionJob *)b)->cost;
+	
+	if (c1 != c2)
+		return (c1 > c2) ? -1 : 1;
+	return ((RegionJob *)a)->region - ((RegionJob *)b)->region;
+}
+
+/* Keeps only the clauses of the n regions in list, in that order, and
+   renumbers their variables from 1. */
+void restrictToRegions (int *list, int n)
+{
+	ClausePtr *newClauses;
+	ClausePtr clause;
+	int *newClass, *newStartvs, *newFinishvs, *index;
+	mpz_t *newCounts;
+	int i,c,p,r,shift,count,offset;
+	
+	for (i=0, count=0; i<n; i++)
+		count += regionFinishc[list[i]] - regionStartc[list[i]] + 1;
+	newClauses = checkMalloc ((1+count)*sizeof(ClausePtr), "regionclauses");
+	newStartvs = checkMalloc ((1+n)*sizeof(int), "startvs");
+	newFinishvs = checkMalloc ((1+n)*sizeof(int), "finishvs");
+	index = checkMalloc (regionsCount*sizeof(int), "regionindex");
+	for (r=0; r<regionsCount; r++)
+		index[r] = -1;
+	
+	for (i=0, count=0, offset=0; i<n; i++)
+	{
+		r = list[i];
+		index[r] = i;
+		shift = offset + 1 - startvs[r];
+		for (c=regionStartc[r]; c<=regionFinishc[r]; c++)
+		{
+			clause = clauses[c];
+			for (p=0; p<clause->length; p++)
+				clause->lits[p] += (clause->lits[p] > 0) ? shift : -shift;
+			newClauses[count++] = clause;
+		}
+		newStartvs[i] = offset + 1;
+		offset += finishvs[r] - startvs[r] + 1;
+		newFinishvs[i] = offset;
+	}
+	
+	newClass = NULL;
+	newCounts = NULL;
+	if (regionClass != NULL && n > 1)
+	{
+		newClass = checkMalloc (n*sizeof(int), "regionclass");
+		newCounts = checkMalloc (n*sizeof(mpz_t), "regioncounts");
+		for (i=0; i<n; i++)
+		{
+			r = regionClass[list[i]];
+			newClass[i] = (index[r] >= 0) ? index[r] : i;
+			if (newClass[i] == i)
+				mpz_init (newCounts[i]);
+		}
+	}
+	regionClass = newClass;
+	regionCounts = newCounts;
+	
+	checkFree (index);
+	checkFree (clauses);
+	checkFree (startvs);
+	checkFree (finishvs);
+	checkFree (regionStartc);
+	checkFree (regionFinishc);
+	regionStartc = regionFinishc = NULL;
+	clauses = newClauses;
+	startvs = newStartvs;
+	finishvs = newFinishvs;
+	numClauses = count;
+	numVars = offset;
+	regionsCount = n;
+}
+
+void stopRegionWorkers()
+{
+	int j;
+	
+	for (j=0; j<numRegionJobs; j++)
+		if (regionJobs[j].pid > 0)
+		{
+			kill (regionJobs[j].pid, SIGKILL);
+			waitpid (regionJobs[j].pid, NULL, 0);
+			regionJobs[j].pid = 0;
+		}
+	numRegionJobs = 0;
+}
+
+/* Called by printFinal in a child, which writes the status and, if it
+   succeeded, the count of its region. */
+void reportRegionResult (int status)
+{
+	fprintf (regionResult, "%d\n", status);
+	if (status == STATUS_SUCCESSFUL)
+		mpz_out_str (regionResult, 16, ((BitSetPtr)clauseSet->first->items[0])->contribution);
+	fclose (regionResult);
+	exit (0);
+}
+
+/* Returns false if the worker could not be started. */
+int startRegionWorker (RegionJob *job)
+{
+	fflush (NULL);
+	job->pid = 0;
+	job->result = tmpfile();
+	if (job->result == NULL || (job->pid = fork()) < 0)
+	{
+		fprintf (outFile, "c Warning - could not start a region worker, counting region %d here\n", job->region); fflush (outFile);
+		if (job->result != NULL)
+			fclose (job->result);
+		job->pid = 0;
+		return false;
+	}
+	if (job->pid == 0)
+	{
+		numRegionJobs = 0;
+		regionResult = job->result;
+		outFile = fopen ("/dev/null", "w");
+		if (outFile == NULL)
+			outFile = stderr;
+		restrictToRegions (&job->region, 1);
+		initTrees();
+		initBitSets();
+		buildLists();
+		printFinal (STATUS_SUCCESSFUL);
+	}
+	return true;
+}
+
+/* Waits for one worker to finish and multiplies its count into
+   regionsProduct. Returns false if none are running. */
+int collectRegionWorker()
+{
+	pid_t pid;
+	int j,status,result;
+	mpz_t count;
+	
+	do
+		pid = wait (&status);
+	while (pid < 0 && errno == EINTR);
+	if (pid < 0)
+		return false;
+	for (j=0; j<numRegionJobs && regionJobs[j].pid != pid; j++);
+	if (j == numRegionJobs)
+		return true;
+	regionJobs[j].pid = 0;
+	
+	result = STATUS_OUT_OF_MEMORY;
+	mpz_init (count);
+	rewind (regionJobs[j].result);
+	if (WIFEXITED(status) && fscanf (regionJobs[j].result, "%d", &result) == 1 && result == STATUS_SUCCESSFUL &&
+		mpz_inp_str (count, regionJobs[j].result, 16) == 0)
+		result = STATUS_OUT_OF_MEMORY;
+	fclose (regionJobs[j].result);
+	if (result != STATUS_SUCCESSFUL)
+	{
+		stopRegionWorkers();
+		printFinal (result);
+	}
+	mpz_pow_ui (count, count, regionJobs[j].multiplicity);
+	mpz_mul (regionsProduct, regionsProduct, count);
+	mpz_clear (count);
+	return true;
+}
+
+/* Counts the proposition, sending its large regions to workers. */
+void countRegions()
+{
+	int *rest, *copies, *byWorker;
+	int c,j,r,numRest,running,workers;
+	long *cost;
+	
+	mpz_init_set_ui (regionsProduct, 1);
+	if (regionsCount > 1 && regionSweepClauses > 0)
+	{
+		if (regionStartc == NULL)
+			findRegionClauses();
+		findIsomorphicRegions();
+		
+		cost = checkMalloc (regionsCount*sizeof(long), "regioncost");
+		copies = checkMalloc (regionsCount*sizeof(int), "regioncopies");
+		for (r=0; r<regionsCount; r++)
+		{
+			cost[r] = 0;
+			copies[r] = 0;
+			for (c=regionStartc[r]; c<=regionFinishc[r]; c++)
+				cost[r] += clauses[c]->length;
+		}
+		if (regionClass != NULL)
+			for (r=0; r<regionsCount; r++)
+				copies[regionClass[r]]++;
+		else
+			for (r=0; r<regionsCount; r++)
+				copies[r] = 1;
+		
+		regionJobs = checkMalloc (regionsCount*sizeof(RegionJob), "regionjobs");
+		rest = checkMalloc (regionsCount*sizeof(int), "regionrest");
+		numRest = 0;
+		workers = 0;
+		for (r=0; r<regionsCount; r++)
+		{
+			if (regionFinishc[r] - regionStartc[r] + 1 < regionSweepClauses)
+				rest[numRest++] = r;
+			else if (copies[r] > 0)
+			{
+				regionJobs[workers].region = r;
+				regionJobs[workers].multiplicity = copies[r];
+				regionJobs[workers].cost = cost[r];
+				regionJobs[workers].pid = 0;
+				workers++;
+			}
+		}
+		checkFree (cost);
+		checkFree (copies);
+		
+		if (numThreads > 1 && workers > 0 && workers + (numRest > 0) > 1)
+		{
+			fprintf (outFile, "c o REGION-WORKERS=%d\n", workers); fflush (outFile);
+			if (memoryLimit > 0)
+			{
+				memoryLimitMegaBytes = megaBytes + (memoryLimitMegaBytes - megaBytes)/(numThreads+1);
+				fprintf (outFile, "c o REGION-WORKER-MEMORY=%dMB\n", memoryLimitMegaBytes-megaBytes); fflush (outFile);
+			}
+			qsort (regionJobs, workers, sizeof(RegionJob), regionJobCompare);
+			byWorker = checkMalloc (regionsCount*sizeof(int), "regionbyworker");
+			for (r=0; r<regionsCount; r++)
+				byWorker[r] = false;
+			running = 0;
+			for (j=0; j<workers; j++)
+			{
+				if (running >= numThreads)
+				{
+					collectRegionWorker();
+					running--;
+				}
+				numRegionJobs = j+1;
+				if (startRegionWorker (&regionJobs[j]))
+				{
+					byWorker[regionJobs[j].region] = true;
+					running++;
+				}
+			}
+			if (running >= numThreads && numRest > 0)
+			{
+				collectRegionWorker();
+				running--;
+			}
+			/* the regions left, with those whose worker did not start */
+			for (r=0, numRest=0; r<regionsCount; r++)
+				if (!byWorker[regionClass != NULL ? regionClass[r] : r])
+					rest[numRest++] = r;
+			checkFree (byWorker);
+			restrictToRegions (rest, numRest);
+			if (numRest > 0)
+			{
+				initTrees();
+				initBitSets();
+				buildLists();
+			}
+			while (running > 0)
+			{
+				collectRegionWorker();
+				running--;
+			}
+			numRegionJobs = 0;
+			checkFree (rest);
+			return;
+		}
+		checkFree (rest);
+		checkFree (regionJobs);
+		regionJobs = NULL;
+	}
+	
+	initTrees();
+	initBitSets();
+	buildLists();
 }
 
 void term (int signum)
@@ -3665,7 +8221,7 @@ void optimiseClause (ClausePtr clause)
 	v2 = 1;
 			//fprintf (outFile, "opt "); fprintClause (outFile, clause);
 			
-	qsort (clause->lits, clause->length, sizeof(int), litCompare);
+	sortLits (&normaliser, clause->lits, clause->length);
 	for (v1=1;v1<clause->length;v1++)
 	{
 		if (clause->lits[v1] == -clause->lits[v1-1])
@@ -3679,98 +8235,471 @@ void optimiseClause (ClausePtr clause)
 			
 }
 
+/* Finds the strongly connected components of the implication graph of the
+   binary clauses, whose nodes are literals indexed by LIT2CODE, with an
+   iterative version of Tarjan's algorithm. On return component[code] holds
+   the number of the component of each literal. */
+void findComponents (int numNodes, int *edgeStart, int *edges, int *component)
+{
+	int *index, *low, *stack, *callStack, *edgePos, *onStack;
+	int counter = 0, stackSize = 0, callSize = 0, numComponents = 0;
+	int s, v, w, u;
+	
+	index = checkMalloc (numNodes*sizeof(int), "sccindex");
+	low = checkMalloc (numNodes*sizeof(int), "scclow");
+	stack = checkMalloc (numNodes*sizeof(int), "sccstack");
+	callStack = checkMalloc (numNodes*sizeof(int), "scccallstack");
+	edgePos = checkMalloc (numNodes*sizeof(int), "sccedgepos");
+	onStack = checkMalloc (numNodes*sizeof(int), "scconstack");
+	for (v=0; v<numNodes; v++)
+	{
+		index[v] = -1;
+		onStack[v] = false;
+	}
+	
+	for (s=0; s<numNodes; s++)
+	{
+		if (index[s] >= 0)
+			continue;
+		index[s] = low[s] = counter++;
+		stack[stackSize++] = s;
+		onStack[s] = true;
+		edgePos[s] = edgeStart[s];
+		callStack[callSize++] = s;
+		
+		while (callSize > 0)
+		{
+			v = callStack[callSize-1];
+			if (edgePos[v] < edgeStart[v+1])
+			{
+				w = edges[edgePos[v]++];
+				if (index[w] < 0)
+				{
+					index[w] = low[w] = counter++;
+					stack[stackSize++] = w;
+					onStack[w] = true;
+					edgePos[w] = edgeStart[w];
+					callStack[callSize++] = w;
+				}
+				else if (onStack[w] && index[w] < low[v])
+					low[v] = index[w];
+			}
+			else
+			{
+				callSize--;
+				if (low[v] == index[v])
+				{
+					do
+					{
+						u = stack[--stackSize];
+						onStack[u] = false;
+						component[u] = numComponents;
+					} while (u != v);
+					numComponents++;
+				}
+				if (callSize > 0 && low[v] < low[callStack[callSize-1]])
+					low[callStack[callSize-1]] = low[v];
+			}
+		}
+	}
+	
+	checkFree (index);
+	checkFree (low);
+	checkFree (stack);
+	checkFree (callStack);
+	checkFree (edgePos);
+	checkFree (onStack);
+}
+
+/* Literals which imply each other through the binary clauses are equivalent.
+   Each class of equivalent literals is replaced by the literal of its lowest
+   variable, and the other variables are marked as optimised so that they are
+   left out of the renumbering in sortSubProblems. The count is unchanged
+   since the values of the replaced variables follow from the rest. */
 void optimisePairs()
 {
-	ClausePtr clause1,clause2;
-	int c,v1,v2,l1,l2,la1,la2,oldNumClauses,v,temp;
-	int pairsFound = 0, found;
+	ClausePtr clause;
+	int c,v,p,lit,code,numNodes,oldNumClauses,eliminated;
+	int *edgeStart, *edges, *fill, *component, *representative;
 	
-	optimised = (int *) checkMalloc ( (1+numVars)*sizeof(int), "optimised");
-	for (v=1;v<=numVars;v++)
-		optimised[v] = 0;
+	numNodes = 2*numVars+2;
+	edgeStart = checkMalloc ((numNodes+1)*sizeof(int), "edgestart");
+	memset (edgeStart, 0, (numNodes+1)*sizeof(int));
+	for (c=0; c<numClauses; c++)
+	{
+		clause = clauses[c];
+		if (!clause->redundant && clause->length == 2)
+		{
+			edgeStart[LIT2CODE(-clause->lits[0])+1]++;
+			edgeStart[LIT2CODE(-clause->lits[1])+1]++;
+		}
+	}
+	for (code=1; code<=numNodes; code++)
+		edgeStart[code] += edgeStart[code-1];
+	if (edgeStart[numNodes] == 0)
+	{
+		checkFree (edgeStart);
+		return;
+	}
+	
+	edges = checkMalloc (edgeStart[numNodes]*sizeof(int), "edges");
+	fill = checkMalloc (numNodes*sizeof(int), "edgefill");
+	memcpy (fill, edgeStart, numNodes*sizeof(int));
+	for (c=0; c<numClauses; c++)
+	{
+		clause = clauses[c];
+		if (!clause->redundant && clause->length == 2)
+		{
+			edges[fill[LIT2CODE(-clause->lits[0])]++] = LIT2CODE(clause->lits[1]);
+			edges[fill[LIT2CODE(-clause->lits[1])]++] = LIT2CODE(clause->lits[0]);
+		}
+	}
+	checkFree (fill);
+	
+	component = checkMalloc (numNodes*sizeof(int), "component");
+	findComponents (numNodes, edgeStart, edges, component);
+	checkFree (edges);
+	checkFree (edgeStart);
+	
+	/* the representative of a component is its literal with the lowest variable,
+	   which is found first since the codes increase with the variable */
+	representative = checkMalloc (numNodes*sizeof(int), "representative");
+	for (code=0; code<numNodes; code++)
+		representative[code] = 0;
+	eliminated = 0;
+	for (v=1; v<=numVars; v++)
+	{
+		for (p=0; p<2; p++)
+		{
+			lit = p ? v : -v;
+			code = LIT2CODE(lit);
+			if (representative[component[code]] == 0)
+				representative[component[code]] = lit;
+		}
+		if (component[LIT2CODE(v)] == component[LIT2CODE(-v)])
+		{
+			fprintf (outFile, "c o Variable %d is equivalent to its negation\n", v);
+			unsatReason = "equivalent literals";
+			printFinal (STATUS_UNSAT_FOUND);
+		}
+		if (abs(representative[component[LIT2CODE(v)]]) != v)
+		{
+			optimised[v] = 1;
+			eliminated++;
+		}
+	}
+	
+	fprintf (outFile, "c o EQUIVALENT-VARIABLES=%d\n", eliminated); fflush (outFile);
+	if (eliminated == 0)
+	{
+		checkFree (component);
+		checkFree (representative);
+		return;
+	}
+	
+	for (c=0; c<numClauses; c++)
+	{
+		clause = clauses[c];
+		if (!clause->redundant)
+		{
+			for (p=0; p<clause->length; p++)
+				clause->lits[p] = representative[component[LIT2CODE(clause->lits[p])]];
+			optimiseClause (clause);
+		}
+	}
+	checkFree (component);
+	checkFree (representative);
 	
-	return;
+	oldNumClauses = numClauses;
+	numClauses = 0;
+	for (c=0;c<oldNumClauses;c++)
+	{
+		if (!clauses[c]->redundant)
+			clauses[numClauses++] = clauses[c];
+	}
+	removeDuplicateClauses();
+	markUnusedVariables();
+}
 
-	setUpVarToClause();
+#define GATE_OCCURRENCE_LIMIT	64
+#define GATE_STEPS	100000000
+#define GATE_AND	0
+#define GATE_XOR	1
+#define GATE_ITE	2
+
+/* Returns the number of a clause with exactly the given literals, the first
+   of which must be lit, or -1 if there is none. */
+int findGateClause (int length, int lit, int a, int b)
+{
+	int o,p,c,found,code = LIT2CODE(lit);
+	ClausePtr clause;
 	
+	for (o=occStart[code]; o<occStart[code+1]; o++)
+	{
+		c = occClauses[o];
+		clause = clauses[c];
+		if (clause->redundant || clause->length != length)
+			continue;
+		found = 0;
+		for (p=0; p<length; p++)
+			if (clause->lits[p] == lit || clause->lits[p] == a || (length == 3 && clause->lits[p] == b))
+				found++;
+		if (found == length)
+			return c;
+	}
+	return -1;
+}
 
-	for (c=0;c<numClauses;c++)
+/* Looks for clauses defining the literal x as an AND (which covers OR for the
+   other sign), an XOR or an if-then-else of other variables. On success the
+   numbers of the defining clauses are put in gate and their count is
+   returned, otherwise 0. */
+int findGate (int x, int *gate, int *kind)
+{
+	int o,o2,p,i,c,c2,a,b,n,code = LIT2CODE(x);
+	int binaries = 0, ternaries = 0;
+	ClausePtr clause, clause2;
+	
+	for (o=occStart[LIT2CODE(-x)]; o<occStart[LIT2CODE(-x)+1]; o++)
+	{
+		if (clauses[occClauses[o]]->length == 2)
+			binaries++;
+		else if (clauses[occClauses[o]]->length == 3)
+			ternaries++;
+	}
+	
+	/* x | -a1 | ... | -ak with -x | ai for each i */
+	for (o=occStart[code]; o<occStart[code+1] && binaries > 0; o++)
+	{
+		c = occClauses[o];
+		clause = clauses[c];
+		if (clause->redundant || clause->length < 2 || clause->length > binaries+1)
+			continue;
+		n = 0;
+		gate[n++] = c;
+		for (p=0; p<clause->length && n > 0; p++)
+		{
+			if (clause->lits[p] == x)
+				continue;
+			c2 = findGateClause (2, -x, -clause->lits[p], 0);
+			if (c2 < 0)
+				n = 0;
+			else
+				gate[n++] = c2;
+		}
+		if (n > 0)
+		{
+			*kind = GATE_AND;
+			return n;
+		}
+	}
+	
+	for (o=occStart[code]; o<occStart[code+1] && ternaries >= 2; o++)
 	{
-		clause1 = clauses[c];
-		if (!clause1->redundant && clause1->length == 2)
+		c = occClauses[o];
+		clause = clauses[c];
+		if (clause->redundant || clause->length != 3)
+			continue;
+		a = (clause->lits[0] == x) ? clause->lits[1] : clause->lits[0];
+		b = (clause->lits[2] == x) ? clause->lits[1] : clause->lits[2];
+		
+		/* x | a | b, x | -a | -b, -x | -a | b, -x | a | -b */
+		gate[0] = c;
+		gate[1] = findGateClause (3, x, -a, -b);
+		gate[2] = findGateClause (3, -x, -a, b);
+		gate[3] = findGateClause (3, -x, a, -b);
+		if (gate[1] >= 0 && gate[2] >= 0 && gate[3] >= 0)
 		{
-			l1 = clause1->lits[0];
-			v1 = abs(l1);
-			l2 = clause1->lits[1];
-			v2 = abs (l2);
-			if (v1 > v2)
+			*kind = GATE_XOR;
+			return 4;
+		}
+		
+		/* x | a | b, x | -a | e, -x | a | -b, -x | -a | -e with a the condition */
+		for (i=0; i<2; i++)
+		{
+			if (i == 1)
 			{
-				temp = v1;
-				v1 = v2;
-				v2 = temp;
-				temp = l1;
-				l1 = l2;
-				l2 = temp;
+				n = a;
+				a = b;
+				b = n;
 			}
-			found = 0;
-			startScanBlockList (varToClause[v1]);
-			while (!found && hasNextBlockList(varToClause[v1]))
+			gate[0] = c;
+			gate[1] = findGateClause (3, -x, a, -b);
+			if (gate[1] < 0)
+				continue;
+			for (o2=occStart[code]; o2<occStart[code+1]; o2++)
 			{
-				clause2 = getNextBlockList(varToClause[v1]);
-				if (clause2->length == 2)
+				clause2 = clauses[occClauses[o2]];
+				if (clause2->redundant || clause2->length != 3 || occClauses[o2] == c)
+					continue;
+				for (p=0; p<3; p++)
+					if (clause2->lits[p] == -a)
+						break;
+				if (p == 3)
+					continue;
+				n = clause2->lits[(p+1)%3] == x ? clause2->lits[(p+2)%3] : clause2->lits[(p+1)%3];
+				if (abs(n) == abs(a) || abs(n) == abs(b))
+					continue;
+				gate[2] = occClauses[o2];
+				gate[3] = findGateClause (3, -x, -a, -n);
+				if (gate[3] >= 0)
 				{
-					la1 = clause2->lits[0];
-					la2 = clause2->lits[1];
-					if ( ( la1 == -l1 && la2 == -l2) || ( la1 == -l2 && la2 == -l1))
-					{
-						clause1->redundant = 1;
-						clause2->redundant = 1;
-						optimised[v2] = 1;
-						pairsFound++;
-						found = 1;
-					}
+					*kind = GATE_ITE;
+					return 4;
 				}
 			}
-			if (found)
+		}
+	}
+	return 0;
+}
+
+/* Writes the resolvent of the two clauses on the variable v to lits and
+   returns its length, or -1 if it is a tautology. The literals of both are
+   in the order of their codes, and so are those of the resolvent. */
+int resolveClauses (ClausePtr clause1, ClausePtr clause2, int v, int *lits)
+{
+	int p1 = 0, p2 = 0, length = 0, lit;
+	
+	while (p1 < clause1->length || p2 < clause2->length)
+	{
+		if (p2 == clause2->length || (p1 < clause1->length &&
+			LIT2CODE(clause1->lits[p1]) <= LIT2CODE(clause2->lits[p2])))
+		{
+			lit = clause1->lits[p1++];
+			if (p2 < clause2->length && clause2->lits[p2] == lit)
+				p2++;
+		}
+		else
+			lit = clause2->lits[p2++];
+		if (abs(lit) == v)
+			continue;
+		if (length > 0 && lits[length-1] == -lit)
+			return -1;
+		lits[length++] = lit;
+	}
+	return length;
+}
+
+/* A variable defined by a gate is eliminated by replacing its clauses with the
+   resolvents of the gate clauses with the others, leaving out those between
+   gate clauses, as long as the number of clauses does not grow. Since the
+   gate fixes its value from the inputs every model of the remaining clauses
+   extends to exactly one model of the original ones, so the count is kept.
+   The occurrence lists are built once per round and any variable sharing a
+   clause with one eliminated in the round waits for the next. */
+void eliminateGates()
+{
+	int *touched, *gate, *isGate, *lits;
+	int v,c,o1,o2,p,i,code,kind,gateSize,numOcc,numResolvents,length;
+	int capacity, steps = 0, eliminatedInRound, oldNumClauses;
+	int eliminated[3] = {0, 0, 0};
+	ClausePtr clause1, clause2, resolvent;
+	
+	if (numClauses == 0)
+		return;
+	touched = checkMalloc ((1+numVars)*sizeof(int), "touched");
+	gate = checkMalloc ((GATE_OCCURRENCE_LIMIT+1)*sizeof(int), "gate");
+	lits = checkMalloc ((2*numVars+2)*sizeof(int), "resolventlits");
+	capacity = numClauses;
+	do
+	{
+		eliminatedInRound = 0;
+		buildOccurrences();
+		isGate = checkMalloc (numClauses*sizeof(int), "isgate");
+		memset (isGate, 0, numClauses*sizeof(int));
+		for (v=1; v<=numVars; v++)
+			touched[v] = false;
+		
+		for (v=1; v<=numVars && steps < GATE_STEPS; v++)
+		{
+			numOcc = occStart[LIT2CODE(v)+1] - occStart[LIT2CODE(-v)];
+			if (optimised[v] || touched[v] || numOcc == 0 || numOcc > GATE_OCCURRENCE_LIMIT)
+				continue;
+			gateSize = findGate (v, gate, &kind);
+			if (gateSize == 0)
+				gateSize = findGate (-v, gate, &kind);
+			if (gateSize == 0)
+				continue;
+			steps += numOcc*numOcc;
+			
+			for (i=0; i<gateSize; i++)
+				isGate[gate[i]] = true;
+			numResolvents = 0;
+			for (o1=occStart[LIT2CODE(v)]; o1<occStart[LIT2CODE(v)+1]; o1++)
+				for (o2=occStart[LIT2CODE(-v)]; o2<occStart[LIT2CODE(-v)+1]; o2++)
+					if (isGate[occClauses[o1]] != isGate[occClauses[o2]] &&
+						resolveClauses (clauses[occClauses[o1]], clauses[occClauses[o2]], v, lits) >= 0)
+						numResolvents++;
+			
+			if (numResolvents <= numOcc)
 			{
-				startScanBlockList (varToClause[v2]);
-				while (hasNextBlockList(varToClause[v2]))
-				{
-					clause2 = getNextBlockList(varToClause[v2]);
-					if (!clause2->redundant)
+				for (o1=occStart[LIT2CODE(v)]; o1<occStart[LIT2CODE(v)+1]; o1++)
+					for (o2=occStart[LIT2CODE(-v)]; o2<occStart[LIT2CODE(-v)+1]; o2++)
 					{
-						for (v=0; v<clause2->length; v++)
+						clause1 = clauses[occClauses[o1]];
+						clause2 = clauses[occClauses[o2]];
+						if (isGate[occClauses[o1]] == isGate[occClauses[o2]])
+							continue;
+						length = resolveClauses (clause1, clause2, v, lits);
+						if (length < 0)
+							continue;
+						if (length == 0)
+						{
+							unsatReason = "gate elimination";
+							printFinal (STATUS_UNSAT_FOUND);
+						}
+						resolvent = newClause();
+						resolvent->length = length;
+						resolvent->lits = checkMalloc (length*sizeof(int), "resolvent");
+						memcpy (resolvent->lits, lits, length*sizeof(int));
+						if (numClauses == capacity)
 						{
-							if (abs(clause2->lits[v]) == v2)
-								if (clause2->lits[v] == l2)
-									clause2->lits[v] = -l1;
-								else
-									clause2->lits[v] = l1;
+							capacity *= 2;
+							clauses = checkRealloc (clauses, capacity*sizeof(ClausePtr), "clauses");
 						}
-						optimiseClause(clause2);
+						clauses[numClauses++] = resolvent;
 					}
-				}
-				
-			
+				for (code=LIT2CODE(-v); code<=LIT2CODE(v); code++)
+					for (o1=occStart[code]; o1<occStart[code+1]; o1++)
+					{
+						clause1 = clauses[occClauses[o1]];
+						clause1->redundant = true;
+						for (p=0; p<clause1->length; p++)
+							touched[abs(clause1->lits[p])] = true;
+					}
+				optimised[v] = 1;
+				eliminated[kind]++;
+				eliminatedInRound++;
 			}
-			
+			for (i=0; i<gateSize; i++)
+				isGate[gate[i]] = false;
 		}
-	}
-	
-	if (pairsFound > 0)
-	{
-		fprintf (outFile, "c o PAIRSFOUND=%d\n", pairsFound);
+		
+		checkFree (isGate);
+		freeOccurrences();
 		oldNumClauses = numClauses;
 		numClauses = 0;
-		for (c=0;c<oldNumClauses;c++)
+		for (c=0; c<oldNumClauses; c++)
 		{
-			if (!clauses[c]->redundant)
+			if (clauses[c]->redundant)
+				freeClause (clauses[c]);
+			else
 				clauses[numClauses++] = clauses[c];
 		}
-
-	}
+	} while (eliminatedInRound > 0 && steps < GATE_STEPS);
+	
+	checkFree (touched);
+	checkFree (gate);
+	checkFree (lits);
 	
-	freeVarToClause();
+	fprintf (outFile, "c o AND-GATES=%d\n", eliminated[GATE_AND]); fflush (outFile);
+	fprintf (outFile, "c o XOR-GATES=%d\n", eliminated[GATE_XOR]); fflush (outFile);
+	fprintf (outFile, "c o ITE-GATES=%d\n", eliminated[GATE_ITE]); fflush (outFile);
+	if (eliminated[GATE_AND] + eliminated[GATE_XOR] + eliminated[GATE_ITE] > 0)
+	{
+		removeDuplicateClauses();
+		markUnusedVariables();
+	}
 }
 
 int main(int argc, char *argv[])
@@ -3796,15 +8725,27 @@ int main(int argc, char *argv[])
 			
 	processArgs (argc, argv);
 	
-	readProposition();
+	if (!readCachedProposition())
+	{
+		readProposition();
+		
+		if (!noReduce)
+		{
+			probeBackbone();
+			propagateUnitClauses();
+			subsumeClauses();
+			recoverXors();
+			optimisePairs();
+			eliminateGates();
+
+			sortSubProblems();
+			
+			writeCachedProposition();
+		}
+	}
 	
 	if (!noReduce)
 	{
-		propagateUnitClauses();
-		optimisePairs();
-
-		sortSubProblems();
-	
 		fprintf (outFile, "c o FINAL-VARIABLES=%d\n",numVars); fflush (outFile);
 		fprintf (outFile, "c o FINAL-CLAUSES=%d\n",numClauses); fflush (outFile);
 
@@ -3816,11 +8757,10 @@ int main(int argc, char *argv[])
 	
 
 	
-	initTrees();
-	
-	initBitSets();
+	if (predictReport > 0)
+		reportPrediction();
 	
-	buildLists();
+	countRegions();
 	
 	printFinal (STATUS_SUCCESSFUL);
 	